@@ -1,8 +1,13 @@
 #pragma once
 
 #include <Arduino.h>
+#include "feature_config.h"
+#ifdef LOG_USE_SYSLOG
 #include <WiFiUdp.h>
-#include "settings.h"
+#endif
+#ifdef LOG_USE_BINARY
+#include "log_ring.h"
+#endif
 
 #define SYSLOG_PORT 514
 
@@ -29,6 +34,25 @@ public:
         Serial.println("");
 #endif
     }
+    // Starts the binary log once the SD card is available
+    void beginRing()
+    {
+#ifdef LOG_USE_BINARY
+        ring.begin();
+#endif
+    }
+    void handle()
+    {
+#ifdef LOG_USE_BINARY
+        ring.handle();
+#endif
+    }
+#ifdef LOG_USE_BINARY
+    void dump(log_line_writer_t write_line)
+    {
+        ring.dump(write_line);
+    }
+#endif
     void error(const char *fmt, ...)
     {
         va_list args;
@@ -59,10 +83,26 @@ protected:
         PriError = PRI_ERROR
     };
 
+#ifdef LOG_USE_SYSLOG
     WiFiUDP udp;
+#endif
+#ifdef LOG_USE_BINARY
+    LogRing ring;
+#endif
 
     void write(Prio pri, const char *fmt, va_list args)
     {
+#ifdef LOG_USE_BINARY
+        va_list ring_args;
+        va_copy(ring_args, args);
+        ring.write(pri, fmt, ring_args);
+        va_end(ring_args);
+        if (pri == PriError)
+        {
+            ring.flush();
+        }
+#endif
+#if defined(LOG_USE_SYSLOG) || defined(LOG_USE_SERIAL)
         char buffer[256];
         vsnprintf(buffer, sizeof(buffer), fmt, args);
 
@@ -71,9 +111,11 @@ protected:
 #endif
 #ifdef LOG_USE_SERIAL
         writeSerial(pri, buffer);
+#endif
 #endif
     }
 
+#ifdef LOG_USE_SYSLOG
     void writeSysLog(Prio pri, char *message)
     {
         char buffer[64];
@@ -83,6 +125,7 @@ protected:
         udp.write(message, strlen(message));
         udp.endPacket();
     }
+#endif
 
     const char *priToString(Prio pri)
     {
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+// Bump allocator for strings that only live while one request is handled.
+// The buffer is static, so these short lived allocations never touch the
+// heap and cannot fragment it, and reset() releases all of them at once.
+// When the arena is full, alloc() returns NULL and the string helpers
+// return "", so the request fails (typically with a 404) instead of the
+// heap being used.
+template <size_t SIZE>
+class Arena
+{
+    char buf[SIZE];
+    size_t used = 0;
+    size_t peak = 0;
+    unsigned long failures = 0;
+
+public:
+    Arena(){};
+
+    size_t get_peak() { return peak; }
+    unsigned long get_failures() { return failures; }
+
+    void reset()
+    {
+        used = 0;
+    }
+
+    void *alloc(size_t size)
+    {
+        size = (size + 3) & ~3; // Keep allocations word aligned
+        if (SIZE - used < size)
+        {
+            failures++;
+            return NULL;
+        }
+        void *ptr = &buf[used];
+        used += size;
+        if (used > peak)
+            peak = used;
+        return ptr;
+    }
+
+    const char *printf(const char *fmt, ...) __attribute__((format(printf, 2, 3)))
+    {
+        size_t space = SIZE - used;
+        va_list args;
+        va_start(args, fmt);
+        int len = vsnprintf(&buf[used], space, fmt, args);
+        va_end(args);
+        if (len < 0 || (size_t)len >= space)
+        {
+            failures++;
+            return "";
+        }
+        return (const char *)alloc(len + 1);
+    }
+
+    const char *strdup(const char *str)
+    {
+        return printf("%s", str);
+    }
+};
@@ -0,0 +1,35 @@
+#include "assets.h"
+#include "feature_config.h"
+
+#if FEATURE_WEB
+
+// Generated by tools/embed_assets.py, run by tools/build.sh. Without it
+// all static files are served from SPIFFS as before, and the pages load
+// the /lib/ files from their CDNs unless they were uploaded too.
+#if defined(__has_include)
+#if __has_include("assets_data.h")
+#include "assets_data.h"
+#define ASSETS_EMBEDDED
+#elif defined(ARDUINO) // Not the host builds in tools/replay
+#warning "assets_data.h missing, build with tools/build.sh to embed the web UI and /lib/"
+#endif
+#endif
+
+const asset_t *assets_find(const char *path)
+{
+#ifdef ASSETS_EMBEDDED
+    uint32_t hash = FNV_OFFSET_BASIS ^ ASSET_HASH_SEED;
+    for (const char *p = path; *p; p++)
+    {
+        hash = (hash ^ (uint8_t)*p) * FNV_PRIME;
+    }
+    const asset_t *asset = &asset_table[hash >> (32 - ASSET_TABLE_BITS)];
+    if (asset->path && strcmp_P(path, asset->path) == 0)
+    {
+        return asset;
+    }
+#endif
+    return NULL;
+}
+
+#endif
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <Arduino.h>
+#include <stdint.h>
+
+#define FNV_OFFSET_BASIS 2166136261u
+#define FNV_PRIME 16777619u
+
+// A gzip compressed file from data/ or vendor/ stored in flash
+typedef struct
+{
+    PGM_P path;
+    PGM_P content_type;
+    PGM_P etag;
+    const uint8_t *data;
+    size_t size;
+} asset_t;
+
+// FNV-1a, usable at compile time so the generated table can be checked
+constexpr uint32_t assets_hash(const char *str, uint32_t hash)
+{
+    return *str ? assets_hash(str + 1, (hash ^ (uint8_t)*str) * FNV_PRIME) : hash;
+}
+
+// Returns NULL if the path is not embedded (or no assets were generated)
+const asset_t *assets_find(const char *path);
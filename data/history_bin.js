@@ -0,0 +1,57 @@
+// Decoder for the binary history format served as /<name>.bin, see
+// history_bin.cpp. Returns the columns as typed arrays, throws if the data
+// is not a complete history.
+function decodeHistory(buffer) {
+  var bytes = new Uint8Array(buffer);
+  var pos = 4;
+
+  if (bytes.length < 4 || String.fromCharCode(bytes[0], bytes[1], bytes[2], bytes[3]) != 'TLH1') {
+    throw new Error('Not a TLH1 history');
+  }
+
+  function next() {
+    if (pos >= bytes.length) {
+      throw new Error('Truncated history');
+    }
+    return bytes[pos++];
+  }
+
+  function varint() {
+    var b = next();
+    if (b < 0x80) {
+      return b;
+    }
+    var value = b & 0x7f, shift = 7;
+    do {
+      b = next();
+      value += (shift < 28) ? (b & 0x7f) << shift : (b & 0x7f) * 268435456;
+      shift += 7;
+    } while (b & 0x80);
+    return value;
+  }
+
+  function zigzag() {
+    var v = varint();
+    return (v & 1) ? -((v + 1) / 2) : v / 2;
+  }
+
+  function column(array, first) {
+    var prev = 0;
+    for (var i = 0; i < array.length; i++) {
+      prev = (i == 0 && first) ? varint() : prev + zigzag();
+      array[i] = prev;
+    }
+    return array;
+  }
+
+  var count = varint();
+  return {
+    TS: column(new Uint32Array(count), true),
+    LVL: column(new Int32Array(count), false),
+    CONS: column(new Int32Array(count), false)
+  };
+}
+
+if (typeof module !== 'undefined') {
+  module.exports = decodeHistory;
+}
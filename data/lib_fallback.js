@@ -0,0 +1,29 @@
+// Loads the libraries from their CDNs when they are not served from /lib/,
+// i.e. the firmware was built without assets_data.h and data/lib/ was not
+// uploaded to SPIFFS. The URLs and hashes are those of VENDOR in
+// tools/embed_assets.py, which checks them on every build.
+(function () {
+  var libs = [
+    [function () { return window.moment; },
+      "https://cdnjs.cloudflare.com/ajax/libs/moment.js/2.22.2/moment.min.js",
+      "sha256-CutOzxCRucUsn6C6TcEYsauvvYilEniTXldPa6/wu0k="],
+    [function () { return window.Chart; },
+      "https://cdnjs.cloudflare.com/ajax/libs/Chart.js/2.8.0/Chart.min.js",
+      "sha256-Uv9BNBucvCPipKQ2NS9wYpJmi8DTOEfTA/nH2aoJALw="],
+    [function () { return window.jQuery; },
+      "https://code.jquery.com/jquery-3.5.1.min.js",
+      "sha256-9/aliU8dGd2tb6OSsuzixeV4y/faTqgFtohetphbbj0="],
+    [function () { return window.Popper; },
+      "https://cdn.jsdelivr.net/npm/popper.js@1.16.0/dist/umd/popper.min.js",
+      "sha384-Q6E9RHvbIyZFJoft+2mJbHaEWldlvI9IOYy5n3zV9zzTtmI3UksdQRVvoxMfooAo"],
+    [function () { return window.jQuery && window.jQuery.fn.modal; },
+      "https://stackpath.bootstrapcdn.com/bootstrap/4.5.0/js/bootstrap.min.js",
+      "sha384-OgVRvuATP1z7JjHLkuOU7Xw704+h835Lr+6QL9UvYjZE3Ipu6Tp75j7Bh/kR0JKI"]
+  ];
+  for (var i = 0; i < libs.length; i++) {
+    if (!libs[i][0]()) {
+      document.write('<script src="' + libs[i][1] + '" integrity="' + libs[i][2] +
+        '" crossorigin="anonymous"><\/script>');
+    }
+  }
+})();
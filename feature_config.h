@@ -0,0 +1,75 @@
+#pragma once
+
+#include "settings.h"
+
+// Compile time feature profiles. Select one with FEATURE_PROFILE in
+// settings.h, and override single FEATURE_* macros there if needed.
+// Disabled subsystems are left out of the build entirely, and so are the
+// libraries only they include. See tools/footprint.py for what each one
+// costs in flash and RAM.
+#define PROFILE_FULL 0      // Everything
+#define PROFILE_NO_SD 1     // No SD card: no stored history, log ring, trace or telemetry spill
+#define PROFILE_PUMP_ONLY 2 // Headless dry run protection: pump and button only, logs to serial
+
+#ifndef FEATURE_PROFILE
+#define FEATURE_PROFILE PROFILE_FULL
+#endif
+
+#if FEATURE_PROFILE == PROFILE_PUMP_ONLY
+#define FEATURE_DEFAULT_WIFI 0
+#define FEATURE_DEFAULT_TANK 0
+#define FEATURE_DEFAULT_SD 0
+#elif FEATURE_PROFILE == PROFILE_NO_SD
+#define FEATURE_DEFAULT_WIFI 1
+#define FEATURE_DEFAULT_TANK 1
+#define FEATURE_DEFAULT_SD 0
+#else
+#define FEATURE_DEFAULT_WIFI 1
+#define FEATURE_DEFAULT_TANK 1
+#define FEATURE_DEFAULT_SD 1
+#endif
+
+#ifndef FEATURE_WIFI
+#define FEATURE_WIFI FEATURE_DEFAULT_WIFI
+#endif
+#ifndef FEATURE_OTA
+#define FEATURE_OTA FEATURE_WIFI
+#endif
+#ifndef FEATURE_MDNS
+#define FEATURE_MDNS FEATURE_WIFI
+#endif
+#ifndef FEATURE_NTP
+#define FEATURE_NTP FEATURE_WIFI
+#endif
+#ifndef FEATURE_TANK // Level sensor, consumption and flow
+#define FEATURE_TANK FEATURE_DEFAULT_TANK
+#endif
+#ifndef FEATURE_WEB
+#define FEATURE_WEB (FEATURE_WIFI && FEATURE_TANK)
+#endif
+#ifndef FEATURE_SD
+#define FEATURE_SD FEATURE_DEFAULT_SD
+#endif
+
+#if (FEATURE_OTA || FEATURE_MDNS || FEATURE_NTP) && !FEATURE_WIFI
+#error "OTA, mDNS and NTP need FEATURE_WIFI"
+#endif
+#if FEATURE_WEB && !(FEATURE_WIFI && FEATURE_TANK)
+#error "The web UI needs FEATURE_WIFI and FEATURE_TANK"
+#endif
+
+// Settings that depend on a disabled subsystem are dropped
+#if !FEATURE_WIFI
+#undef LOG_USE_SYSLOG
+#undef TELEMETRY_SERVER
+#ifndef LOG_USE_SERIAL
+#define LOG_USE_SERIAL
+#endif
+#ifndef LOG_SERIAL_BAUDRATE
+#define LOG_SERIAL_BAUDRATE 115200
+#endif
+#endif
+#if !FEATURE_SD
+#undef LOG_USE_BINARY
+#undef TRACE_RECORD
+#endif
@@ -0,0 +1,159 @@
+#pragma once
+
+#include <RingBufCPP.h>
+
+#include "Log.h"
+#include "pump.h"
+#include "tank.h"
+
+#define FLOW_WINDOW_LEN 30           // Samples (minutes) in the least-squares window
+#define FLOW_MIN_SAMPLES 3           // Samples needed before a rate is reported
+#define FLOW_FILL_THRESHOLD 5        // Per mille/h, rising faster than this while idle is rain
+#define FLOW_LEAK_THRESHOLD 3        // Per mille/h, falling faster than this while idle is a leak
+#define FLOW_LEAK_ALERT_MIN 60       // Minutes of idle loss above threshold before alerting
+
+// Running least-squares slope of the tank level over a sliding window.
+// Samples are assumed to arrive at a fixed cadence (once per minute), so the
+// x values are simply 0..n-1 and every update is O(1): the sums are adjusted
+// for the sample leaving the window and the remaining samples shifted by one.
+class FlowEstimator
+{
+    RingBufCPP<uint16_t, FLOW_WINDOW_LEN> window;
+    long sum_y = 0;
+    long sum_xy = 0;
+
+public:
+    FlowEstimator(){};
+
+    void reset()
+    {
+        uint16_t dummy;
+        while (window.pull(&dummy))
+            ;
+        sum_y = 0;
+        sum_xy = 0;
+    }
+
+    int count()
+    {
+        return window.numElements();
+    }
+
+    void add(uint16_t level)
+    {
+        if (window.isFull())
+        {
+            uint16_t oldest;
+            window.pull(&oldest);
+            sum_y -= oldest;
+            // Shift remaining samples from x = 1..n-1 to x = 0..n-2
+            sum_xy -= sum_y;
+        }
+        long x = window.numElements();
+        window.add(level);
+        sum_y += level;
+        sum_xy += x * level;
+    }
+
+    // Returns slope in per mille per hour (positive when filling)
+    int rate_per_hour()
+    {
+        long n = window.numElements();
+        if (n < 2)
+            return 0;
+        long sum_x = n * (n - 1) / 2;
+        long sum_xx = (n - 1) * n * (2 * n - 1) / 6;
+        long denom = n * sum_xx - sum_x * sum_x;
+        return ((n * sum_xy - sum_x * sum_y) * 60) / denom;
+    }
+};
+
+// Tracks fill, draw and idle loss rates of the tank. The window is restarted
+// whenever the pump starts or stops so each rate only covers one regime.
+class FlowMonitor
+{
+    FlowEstimator estimator;
+    bool pumping = false;
+    int fill_rate = 0;
+    int draw_rate = 0;
+    int loss_rate = 0;
+    int leak_minutes = 0;
+    bool leak = false;
+
+    // Only a full idle window counts either way, so restarting the window
+    // when the pump runs neither raises nor clears the alert
+    void check_for_leak()
+    {
+        if (estimator.count() < FLOW_WINDOW_LEN)
+        {
+            return;
+        }
+        if (loss_rate < FLOW_LEAK_THRESHOLD)
+        {
+            leak_minutes = 0;
+            if (leak)
+            {
+                Log.info("Leak alert cleared");
+                leak = false;
+            }
+            return;
+        }
+        if (++leak_minutes == FLOW_LEAK_ALERT_MIN)
+        {
+            Log.warn("Leak alert: losing %d per mille/h while idle", loss_rate);
+            leak = true;
+        }
+    }
+
+public:
+    FlowMonitor(){};
+
+    int get_fill_rate() { return fill_rate; }
+    int get_draw_rate() { return draw_rate; }
+    int get_loss_rate() { return loss_rate; }
+    bool has_leak() { return leak; }
+
+    int get_rate()
+    {
+        return estimator.count() >= FLOW_MIN_SAMPLES ? estimator.rate_per_hour() : 0;
+    }
+
+    void tick()
+    {
+        bool pump_on = pump_is_on();
+        if (pump_on != pumping)
+        {
+            pumping = pump_on;
+            estimator.reset();
+        }
+        estimator.add(tank_get_level());
+        if (estimator.count() < FLOW_MIN_SAMPLES)
+        {
+            return;
+        }
+
+        int rate = estimator.rate_per_hour();
+        if (pumping)
+        {
+            draw_rate = rate < 0 ? -rate : 0;
+            return;
+        }
+        if (rate > FLOW_FILL_THRESHOLD)
+        {
+            fill_rate = rate;
+            loss_rate = 0;
+        }
+        else
+        {
+            fill_rate = 0;
+            loss_rate = rate < 0 ? -rate : 0;
+        }
+        check_for_leak();
+    }
+
+    String get_stats_json()
+    {
+        return "{\"RATE\":" + String(get_rate()) + ",\"FILL\":" + String(fill_rate) + ",\"DRAW\":" + String(draw_rate) +
+               ",\"LOSS\":" + String(loss_rate) + ",\"LEAK\":" + String(leak ? 1 : 0) + "}";
+    }
+};
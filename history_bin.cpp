@@ -0,0 +1,200 @@
+// Binary history format, all integers are LEB128 varints:
+//   "TLH1"
+//   count
+//   TS column:   first time stamp, then zigzag(ts[i] - ts[i - 1])
+//   LVL column:  zigzag(lvl[i] - lvl[i - 1]), lvl[-1] = 0
+//   CONS column: zigzag(cons[i] - cons[i - 1]), cons[-1] = 0
+// The columns are produced by separate passes over the JSON file so
+// nothing but a small read and write buffer is held in RAM.
+#include "feature_config.h"
+
+#if FEATURE_WEB && FEATURE_SD
+
+#include "history_bin.h"
+#include "sample_ring.h"
+
+#define HISTORY_BIN_BUFFER_SIZE 128
+
+enum Column
+{
+    ColumnTs,
+    ColumnLvl,
+    ColumnCons
+};
+
+class RecordReader
+{
+    File &file;
+    uint8_t buffer[HISTORY_BIN_BUFFER_SIZE];
+    int len = 0;
+    int pos = 0;
+
+    int get()
+    {
+        if (pos == len)
+        {
+            len = file.read(buffer, sizeof(buffer));
+            pos = 0;
+            if (len <= 0)
+            {
+                len = 0;
+                return -1;
+            }
+        }
+        return buffer[pos++];
+    }
+
+public:
+    RecordReader(File &file, int offset) : file(file)
+    {
+        file.seek(offset);
+    }
+
+    // Parses the next {"LVL":812,"TS":1594512000,"CONS":3} record
+    bool next(sample_t &sample)
+    {
+        int c;
+        while ((c = get()) != '{')
+        {
+            if (c < 0)
+                return false;
+        }
+        sample = {};
+        char key[8] = "";
+        int key_len = -1;
+        while ((c = get()) >= 0 && c != '}')
+        {
+            if (c == '"')
+            {
+                key_len = key_len < 0 ? 0 : -1;
+                continue;
+            }
+            if (key_len >= 0)
+            {
+                if (key_len < (int)sizeof(key) - 1)
+                    key[key_len++] = c;
+                key[key_len] = '\0';
+                continue;
+            }
+            if (c != ':')
+                continue;
+
+            bool negative = false;
+            long value = 0;
+            while ((c = get()) == '-' || isdigit(c))
+            {
+                if (c == '-')
+                    negative = true;
+                else
+                    value = value * 10 + (c - '0');
+            }
+            if (negative)
+                value = -value;
+            if (strcmp(key, "LVL") == 0)
+                sample.tank_level = value;
+            else if (strcmp(key, "TS") == 0)
+                sample.time_stamp = value;
+            else if (strcmp(key, "CONS") == 0)
+                sample.consumption = value;
+            if (c == '}')
+                break;
+        }
+        return c == '}';
+    }
+};
+
+class VarintWriter
+{
+    uint8_t buffer[HISTORY_BIN_BUFFER_SIZE];
+    size_t len = 0;
+    bin_writer_t &write;
+
+public:
+    VarintWriter(bin_writer_t &write) : write(write){};
+
+    ~VarintWriter()
+    {
+        flush();
+    }
+
+    void flush()
+    {
+        if (len > 0)
+            write(buffer, len);
+        len = 0;
+    }
+
+    void put_raw(const char *data, size_t size)
+    {
+        flush();
+        write((const uint8_t *)data, size);
+    }
+
+    void put(uint32_t value)
+    {
+        if (len + 5 > sizeof(buffer))
+            flush();
+        while (value >= 0x80)
+        {
+            buffer[len++] = (value & 0x7F) | 0x80;
+            value >>= 7;
+        }
+        buffer[len++] = value;
+    }
+
+    void put_signed(long value)
+    {
+        put(((uint32_t)value << 1) ^ (uint32_t)(value >> 31));
+    }
+};
+
+static long column_value(const sample_t &sample, Column column)
+{
+    switch (column)
+    {
+    case ColumnTs:
+        return sample.time_stamp;
+    case ColumnLvl:
+        return sample.tank_level;
+    default:
+        return sample.consumption;
+    }
+}
+
+int history_bin_write(File &file, int data_offset, bin_writer_t write)
+{
+    sample_t sample;
+    int count = 0;
+    {
+        RecordReader reader(file, data_offset);
+        while (reader.next(sample))
+            count++;
+    }
+
+    VarintWriter out(write);
+    out.put_raw("TLH1", 4);
+    out.put(count);
+    for (int column = ColumnTs; column <= ColumnCons; column++)
+    {
+        RecordReader reader(file, data_offset);
+        long prev = 0;
+        int i = 0;
+        for (; i < count && reader.next(sample); i++)
+        {
+            long value = column_value(sample, (Column)column);
+            if (column == ColumnTs && i == 0)
+                out.put(value);
+            else
+                out.put_signed(value - prev);
+            prev = value;
+        }
+        for (; i < count; i++)
+        {
+            // The file shrank between passes, keep the columns aligned
+            out.put(0);
+        }
+    }
+    return count;
+}
+
+#endif
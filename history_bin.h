@@ -0,0 +1,12 @@
+#pragma once
+
+#include <Arduino.h>
+#include <SD.h>
+#include <functional>
+
+typedef std::function<void(const uint8_t *, size_t)> bin_writer_t;
+
+// Converts the JSON records of a history file, starting at data_offset, to
+// the compact binary history format (see history_bin.cpp and
+// data/history_bin.js). Returns the number of records written.
+int history_bin_write(File &file, int data_offset, bin_writer_t write);
@@ -0,0 +1,129 @@
+#pragma once
+
+#include <stdint.h>
+
+#define LEVEL_EST_SHIFT 4               // Level is kept in 1/16 us of echo duration
+#define LEVEL_EST_MIN_NOISE (2 << LEVEL_EST_SHIFT)     // Sensor resolution, ~0.3 mm
+#define LEVEL_EST_POS_WALK (1 << LEVEL_EST_SHIFT)      // Level model error per sqrt(minute)
+#define LEVEL_EST_RATE_WALK (200 << LEVEL_EST_SHIFT)   // Rate change per sqrt(minute), per hour
+#define LEVEL_EST_INITIAL_RATE (2000 << LEVEL_EST_SHIFT) // Rate uncertainty at start, per hour
+#define LEVEL_EST_GATE 4                // Reject measurements further off than this many sigma
+#define LEVEL_EST_MAX_REJECTS 3         // Accept after this many rejects in a row (real step)
+
+// Median and spread of a burst of echo durations, sorted in place. The
+// spread is the range of the three middle values, so like the median it
+// ignores a single spurious echo.
+inline void level_burst_stats(long *durations, int n, long &median, long &spread)
+{
+    for (int i = 1; i < n; i++)
+    {
+        long value = durations[i];
+        int j = i;
+        for (; j > 0 && durations[j - 1] > value; j--)
+            durations[j] = durations[j - 1];
+        durations[j] = value;
+    }
+    median = durations[n / 2];
+    spread = n >= 3 ? durations[n / 2 + 1] - durations[n / 2 - 1] : 0;
+}
+
+// Fixed point Kalman filter with level and rate state, fed with the median
+// echo duration of each burst. The measurement noise comes from the spread
+// of the burst, so noisy bursts move the estimate less. Measurements far
+// outside the predicted level are treated as spurious echoes, unless they
+// keep coming, in which case the level really moved.
+//
+// Compared with the old median and 8 sample mean it follows a moving level
+// within a minute instead of three, but the estimate changes more from one
+// minute to the next (jitter, see tools/replay/bench_level.cpp).
+//
+// Units: level in 1/16 us, rate in 1/16 us per hour, time in ms.
+class LevelEstimator
+{
+    int32_t level = 0;
+    int32_t rate = 0;
+    int64_t p00 = 0; // Level variance
+    int64_t p01 = 0; // Level/rate covariance
+    int64_t p11 = 0; // Rate variance
+    unsigned long last_ms = 0;
+    int updates = 0;
+    int rejects = 0;
+
+    void predict(unsigned long now_ms)
+    {
+        int64_t dt = now_ms - last_ms;
+        last_ms = now_ms;
+        // a = dt in hours, applied as * dt / 3600000
+        level += (int64_t)rate * dt / 3600000;
+        p00 += (2 * p01 + p11 * dt / 3600000) * dt / 3600000;
+        p01 += p11 * dt / 3600000;
+        p00 += (int64_t)LEVEL_EST_POS_WALK * LEVEL_EST_POS_WALK * dt / 60000;
+        p11 += (int64_t)LEVEL_EST_RATE_WALK * LEVEL_EST_RATE_WALK * dt / 60000;
+    }
+
+public:
+    LevelEstimator(){};
+
+    int count()
+    {
+        return updates;
+    }
+
+    // Returns the echo duration in us
+    long get()
+    {
+        return level >> LEVEL_EST_SHIFT;
+    }
+
+    // Returns the echo duration change in us per hour
+    long get_rate()
+    {
+        return rate >> LEVEL_EST_SHIFT;
+    }
+
+    // Adds the median duration of a burst and its spread, see level_burst_stats()
+    void add(long duration, long spread, unsigned long now_ms)
+    {
+        int64_t z = (int64_t)duration << LEVEL_EST_SHIFT;
+        int64_t noise = ((int64_t)spread << LEVEL_EST_SHIFT) + LEVEL_EST_MIN_NOISE;
+        int64_t r = noise * noise;
+
+        if (updates == 0)
+        {
+            level = z;
+            rate = 0;
+            p00 = r;
+            p01 = 0;
+            p11 = (int64_t)LEVEL_EST_INITIAL_RATE * LEVEL_EST_INITIAL_RATE;
+            last_ms = now_ms;
+            updates = 1;
+            return;
+        }
+
+        predict(now_ms);
+        int64_t y = z - level;
+        int64_t s = p00 + r;
+        if (y * y > (int64_t)LEVEL_EST_GATE * LEVEL_EST_GATE * s)
+        {
+            if (++rejects <= LEVEL_EST_MAX_REJECTS)
+            {
+                return;
+            }
+            // Consistently off, the level has moved: let the next
+            // measurement through with full weight
+            p00 += y * y;
+            s = p00 + r;
+        }
+        rejects = 0;
+
+        // Gains in 1/65536
+        int64_t k0 = (p00 << 16) / s;
+        int64_t k1 = (p01 << 16) / s;
+        level += (k0 * y) >> 16;
+        rate += (k1 * y) >> 16;
+        p11 -= (k1 * p01) >> 16;
+        p01 -= (k0 * p01) >> 16;
+        p00 -= (k0 * p00) >> 16;
+        updates++;
+    }
+};
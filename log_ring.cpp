@@ -0,0 +1,382 @@
+// Segment file layout (/logN.bin):
+//   "TLL1", uint32 build id, uint32 segment sequence number
+//   records: uint8 length of the rest, uint32 now(), uint32 millis(),
+//            uint8 priority, uint32 format string address, arguments
+// Arguments follow the conversions in the format string: 4 bytes for
+// integers, 8 for long long and double, and a length prefixed string of at
+// most LOG_RING_MAX_STRING bytes for %s. All integers are little endian.
+//
+// Format addresses are only meaningful for the firmware that wrote them,
+// identified by the build id (start of the sketch MD5). Records from other
+// builds are decoded by tools/logdecode.py with the matching ELF file.
+#include "feature_config.h"
+
+#ifdef LOG_USE_BINARY
+
+#include <Arduino.h>
+#include <SD.h>
+#include <TimeLib.h>
+
+#include "log_ring.h"
+
+#define LOG_RING_MAX_STRING 48
+#define LOG_RING_MAX_RECORD 255
+#define LOG_RING_HEADER_SIZE 12
+
+enum ArgType
+{
+    ArgNone,
+    ArgInt,
+    ArgLongLong,
+    ArgDouble,
+    ArgString
+};
+
+// Advances fmt past the next conversion and returns its argument type.
+// Literal text and %% are skipped. Returns ArgNone at the end.
+static ArgType next_conversion(const char *&fmt, const char **spec_start)
+{
+    while (*fmt)
+    {
+        if (*fmt++ != '%')
+            continue;
+        if (*fmt == '%')
+        {
+            fmt++;
+            continue;
+        }
+        if (spec_start)
+            *spec_start = fmt - 1;
+        while (*fmt && strchr("-+ #0123456789.", *fmt))
+            fmt++;
+        int longs = 0;
+        while (*fmt && strchr("hlLqjzt", *fmt))
+        {
+            if (*fmt == 'l' || *fmt == 'q' || *fmt == 'L')
+                longs++;
+            fmt++;
+        }
+        char conv = *fmt;
+        if (conv)
+            fmt++;
+        switch (conv)
+        {
+        case 's':
+            return ArgString;
+        case 'f':
+        case 'F':
+        case 'e':
+        case 'E':
+        case 'g':
+        case 'G':
+            return ArgDouble;
+        case '\0':
+            return ArgNone;
+        default:
+            return longs >= 2 ? ArgLongLong : ArgInt;
+        }
+    }
+    return ArgNone;
+}
+
+static void put_u32(uint8_t *dst, uint32_t value)
+{
+    memcpy(dst, &value, sizeof(value));
+}
+
+static uint32_t get_u32(const uint8_t *src)
+{
+    uint32_t value;
+    memcpy(&value, src, sizeof(value));
+    return value;
+}
+
+static const char *pri_name(uint8_t pri)
+{
+    switch (pri)
+    {
+    case 11:
+        return "Error";
+    case 12:
+        return "Warning";
+    case 14:
+        return "Info";
+    default:
+        return "";
+    }
+}
+
+static String segment_path(int segment)
+{
+    return "/log" + String(segment) + ".bin";
+}
+
+size_t log_ring_format(char *out, size_t size, const char *fmt, const uint8_t *args, size_t args_len)
+{
+    size_t len = 0;
+    size_t pos = 0;
+    const char *literal = fmt;
+    const char *spec;
+    ArgType type;
+    char spec_buf[16];
+    auto append = [&](const char *text, size_t n) {
+        n = (n < size - 1 - len) ? n : size - 1 - len;
+        memcpy(&out[len], text, n);
+        len += n;
+    };
+    auto append_literal = [&](const char *text, size_t n) {
+        for (size_t i = 0; i < n; i++)
+        {
+            if (text[i] == '%' && i + 1 < n && text[i + 1] == '%')
+                i++;
+            append(&text[i], 1);
+        }
+    };
+
+    while ((type = next_conversion(fmt, &spec)) != ArgNone)
+    {
+        append_literal(literal, spec - literal);
+        literal = fmt;
+        size_t spec_len = fmt - spec;
+        if (spec_len >= sizeof(spec_buf))
+            spec_len = sizeof(spec_buf) - 1;
+        memcpy(spec_buf, spec, spec_len);
+        spec_buf[spec_len] = '\0';
+
+        char value[64];
+        int n = 0;
+        if (type == ArgString && pos < args_len)
+        {
+            char str[LOG_RING_MAX_STRING + 1];
+            size_t str_len = args[pos++];
+            if (pos + str_len > args_len)
+                str_len = args_len - pos;
+            memcpy(str, &args[pos], str_len);
+            str[str_len] = '\0';
+            pos += str_len;
+            n = snprintf(value, sizeof(value), spec_buf, str);
+        }
+        else if (type == ArgDouble && pos + 8 <= args_len)
+        {
+            double d;
+            memcpy(&d, &args[pos], sizeof(d));
+            pos += sizeof(d);
+            n = snprintf(value, sizeof(value), spec_buf, d);
+        }
+        else if (type == ArgLongLong && pos + 8 <= args_len)
+        {
+            long long ll;
+            memcpy(&ll, &args[pos], sizeof(ll));
+            pos += sizeof(ll);
+            n = snprintf(value, sizeof(value), spec_buf, ll);
+        }
+        else if (type == ArgInt && pos + 4 <= args_len)
+        {
+            n = snprintf(value, sizeof(value), spec_buf, (int)get_u32(&args[pos]));
+            pos += 4;
+        }
+        if (n > 0)
+            append(value, (size_t)n < sizeof(value) ? n : sizeof(value) - 1);
+    }
+    append_literal(literal, strlen(literal));
+    out[len] = '\0';
+    return len;
+}
+
+void LogRing::begin()
+{
+    String md5 = ESP.getSketchMD5();
+    build_id = strtoul(md5.substring(0, 8).c_str(), NULL, 16);
+
+    // Continue after the segment with the highest sequence number
+    for (int i = 0; i < LOG_RING_SEGMENTS; i++)
+    {
+        File file = SD.open(segment_path(i), FILE_READ);
+        uint8_t header[LOG_RING_HEADER_SIZE];
+        if (file && file.read(header, sizeof(header)) == sizeof(header) && memcmp(header, "TLL1", 4) == 0)
+        {
+            uint32_t seq = get_u32(&header[8]);
+            if (segment < 0 || seq > segment_seq)
+            {
+                segment_seq = seq;
+                segment = i;
+            }
+        }
+        if (file)
+            file.close();
+    }
+    started = true;
+    open_next_segment();
+    flush();
+}
+
+void LogRing::open_next_segment()
+{
+    segment = (segment + 1) % LOG_RING_SEGMENTS;
+    segment_seq++;
+    String path = segment_path(segment);
+    SD.remove(path);
+    File file = SD.open(path, FILE_WRITE);
+    if (!file)
+    {
+        started = false;
+        return;
+    }
+    uint8_t header[LOG_RING_HEADER_SIZE];
+    memcpy(header, "TLL1", 4);
+    put_u32(&header[4], build_id);
+    put_u32(&header[8], segment_seq);
+    file.write(header, sizeof(header));
+    file.close();
+}
+
+void LogRing::write(uint8_t pri, const char *fmt, va_list args)
+{
+    uint8_t record[LOG_RING_MAX_RECORD + 1];
+    size_t len = 1;
+    put_u32(&record[len], now());
+    put_u32(&record[len + 4], millis());
+    record[len + 8] = pri;
+    put_u32(&record[len + 9], (uint32_t)(uintptr_t)fmt);
+    len += 13;
+
+    const char *p = fmt;
+    ArgType type;
+    while ((type = next_conversion(p, NULL)) != ArgNone)
+    {
+        if (type == ArgString)
+        {
+            const char *str = va_arg(args, const char *);
+            size_t str_len = str ? strnlen(str, LOG_RING_MAX_STRING) : 0;
+            if (len + 1 + str_len > LOG_RING_MAX_RECORD)
+                break;
+            record[len++] = str_len;
+            memcpy(&record[len], str, str_len);
+            len += str_len;
+            continue;
+        }
+        if (len + 8 > LOG_RING_MAX_RECORD)
+            break;
+        if (type == ArgDouble)
+        {
+            double d = va_arg(args, double);
+            memcpy(&record[len], &d, sizeof(d));
+            len += sizeof(d);
+        }
+        else if (type == ArgLongLong)
+        {
+            long long ll = va_arg(args, long long);
+            memcpy(&record[len], &ll, sizeof(ll));
+            len += sizeof(ll);
+        }
+        else
+        {
+            put_u32(&record[len], va_arg(args, uint32_t));
+            len += 4;
+        }
+    }
+    record[0] = len - 1;
+
+    if (buffer_len + len > sizeof(buffer))
+    {
+        flush();
+        if (buffer_len + len > sizeof(buffer))
+        {
+            dropped++;
+            return;
+        }
+    }
+    memcpy(&buffer[buffer_len], record, len);
+    buffer_len += len;
+}
+
+void LogRing::flush()
+{
+    last_flush_ms = millis();
+    if (!started || buffer_len == 0)
+    {
+        return;
+    }
+    File file = SD.open(segment_path(segment), FILE_WRITE);
+    if (!file)
+    {
+        return;
+    }
+    if (file.size() + buffer_len > LOG_RING_SEGMENT_SIZE)
+    {
+        file.close();
+        open_next_segment();
+        file = SD.open(segment_path(segment), FILE_WRITE);
+        if (!file)
+        {
+            return;
+        }
+    }
+    file.write(buffer, buffer_len);
+    file.close();
+    buffer_len = 0;
+}
+
+void LogRing::handle()
+{
+    if (millis() - last_flush_ms > LOG_RING_FLUSH_INTERVAL_MS)
+    {
+        flush();
+    }
+}
+
+// Appends a newline, there must be room for it. Returns the new length.
+static size_t end_line(char *line)
+{
+    size_t n = strlen(line);
+    line[n++] = '\n';
+    line[n] = '\0';
+    return n;
+}
+
+void LogRing::dump(log_line_writer_t write_line)
+{
+    flush();
+    if (!started)
+    {
+        return;
+    }
+    char line[300];
+    const size_t size = sizeof(line) - 1; // Room for the newline
+    uint8_t record[LOG_RING_MAX_RECORD];
+    for (int i = 1; i <= LOG_RING_SEGMENTS; i++)
+    {
+        File file = SD.open(segment_path((segment + i) % LOG_RING_SEGMENTS), FILE_READ);
+        if (!file)
+        {
+            continue;
+        }
+        uint8_t header[LOG_RING_HEADER_SIZE];
+        bool same_build = file.read(header, sizeof(header)) == sizeof(header) && get_u32(&header[4]) == build_id;
+        int len;
+        while ((len = file.read()) >= 13 && file.read(record, len) == len)
+        {
+            uint32_t fmt = get_u32(&record[9]);
+            uint32_t ms = get_u32(&record[4]);
+            int n = snprintf(line, size, "%u %u.%03u <%s> ", get_u32(&record[0]), ms / 1000, ms % 1000,
+                             pri_name(record[8]));
+            if (same_build)
+            {
+                log_ring_format(&line[n], size - n, (const char *)(uintptr_t)fmt, &record[13], len - 13);
+            }
+            else
+            {
+                snprintf(&line[n], size - n, "[fmt 0x%08x from another build]", fmt);
+            }
+            write_line(line, end_line(line));
+        }
+        file.close();
+    }
+    if (dropped)
+    {
+        snprintf(line, size, "%lu records dropped", dropped);
+        write_line(line, end_line(line));
+    }
+}
+
+#endif
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <Arduino.h>
+#include <stdarg.h>
+#include <functional>
+
+#define LOG_RING_SEGMENTS 8
+#define LOG_RING_SEGMENT_SIZE 8192
+#define LOG_RING_BUFFER_SIZE 512
+#define LOG_RING_FLUSH_INTERVAL_MS 5000
+
+typedef std::function<void(const char *line, size_t len)> log_line_writer_t;
+
+// Binary log kept on SD in LOG_RING_SEGMENTS files of LOG_RING_SEGMENT_SIZE
+// bytes, reused oldest first. Records hold the address of the format string
+// and the raw arguments, so logging costs a walk over the format string
+// instead of a vsnprintf. Records are batched in RAM and flushed every
+// LOG_RING_FLUSH_INTERVAL_MS, when the buffer is full or on errors.
+class LogRing
+{
+    uint8_t buffer[LOG_RING_BUFFER_SIZE];
+    size_t buffer_len = 0;
+    unsigned long last_flush_ms = 0;
+    uint32_t build_id = 0;
+    uint32_t segment_seq = 0;
+    int segment = -1;
+    unsigned long dropped = 0;
+    bool started = false;
+
+    void open_next_segment();
+
+public:
+    void begin();
+    void write(uint8_t pri, const char *fmt, va_list args);
+    void flush();
+    void handle();
+
+    // Decodes all records, oldest first, into text lines ending in a newline
+    void dump(log_line_writer_t write_line);
+};
+
+// Formats a record payload captured by LogRing::write
+size_t log_ring_format(char *out, size_t size, const char *fmt, const uint8_t *args, size_t args_len);
@@ -1,10 +1,12 @@
 #include <Arduino.h>
 #include <TimeLib.h>
 #include "MedianFilterLib.h"
-#include <ESP8266WiFi.h>
 #include "Log.h"
 #include "pins.h"
 #include "pump.h"
+#include "trace.h"
+#include "telemetry.h"
+#include "sampling.h"
 
 #define PUMP_ENABLE_TIME_S (60 * 15)
 
@@ -14,7 +16,12 @@
 
 #define MIN(x, y) (((x) < (y)) ? (x) : (y))
 #define FILTER_LEN 5
+#define BUTTON_INTERVAL_MS 100
+// Current is sampled every 100 ms while the relay may be on, and only every
+// 5 s once the pump has been off or dry run protected for a minute
 #define SAMPLE_INTERVAL_MS 100
+#define TRICKLE_INTERVAL_MS 5000
+#define TRICKLE_HOLD_MS 60000
 
 // 1.5V from ACS712 = 10A, V divider is 1/2.5 => 10A = 1.5 * (1/2.5) = 0.6V at A0 = ADC value ~= 614
 // However, voltage is inverted on A0 => ADC value: 1023-614 = 409 = 10A
@@ -32,12 +39,16 @@ enum PumpState
 };
 
 static int last_second = 0;
-static unsigned long last_sample_time;
+static unsigned long last_button_time;
+static SamplingPolicy current_sampling("Current", TRICKLE_INTERVAL_MS, SAMPLE_INTERVAL_MS, TRICKLE_HOLD_MS);
 static MedianFilter<int> medianFilter(FILTER_LEN);
 static PumpState pump_state = PumpIdle;
 static int enable_timer;
 static bool pump_enabled;
 
+static unsigned long last_handle_us;
+static unsigned long max_handle_gap_us; // Since the last pump_get_max_gap_us()
+
 static int warning_pattern[] = {0, 0, 1, 1, 1, 1, 0, 0, 1, 1, 1, 1, 1, 1, -1};
 static int *warning_ptr;
 
@@ -63,6 +74,7 @@ static bool take_sample()
 {
     static int filter_entries = 0;
     int sample = analogRead(CURRENT_ADC_PIN);
+    trace_record(TraceCurrent, sample);
 
     medianFilter.AddValue(sample);
     if (filter_entries < FILTER_LEN)
@@ -91,6 +103,7 @@ static bool enable_pump(bool enable)
 static PumpState enter_state(PumpState state)
 {
     Log.info("Entering pump state: %s", get_state_string(state).c_str());
+    telemetry_pump_event(get_state_string(state).c_str(), pump_get_current_mA());
     switch (state)
     {
     case PumpIdle:
@@ -212,7 +225,7 @@ static void check_button()
 void pump_init()
 {
     last_second = second();
-    last_sample_time = millis();
+    last_button_time = millis();
     take_sample();
     pump_state = enter_state(PumpOff);
 }
@@ -247,13 +260,30 @@ String pump_get_stats_json()
     return "{\"CUR\":" + current + ",\"ACTIVE\":" + active + ",\"STATE\":" + state + ",\"STATETEXT\":\"" + stateTxt + "\"}";
 }
 
+unsigned long pump_get_max_gap_us()
+{
+    unsigned long gap = max_handle_gap_us;
+    max_handle_gap_us = 0;
+    return gap;
+}
+
 void pump_handle()
 {
     static bool filter_filled = false;
-    if (millis() - last_sample_time > SAMPLE_INTERVAL_MS)
+    unsigned long now_us = micros();
+    if (last_handle_us && now_us - last_handle_us > max_handle_gap_us)
+    {
+        max_handle_gap_us = now_us - last_handle_us;
+    }
+    last_handle_us = now_us;
+
+    if (current_sampling.due(pump_state >= PumpIdle))
     {
-        last_sample_time = millis();
         filter_filled = take_sample();
+    }
+    if (millis() - last_button_time > BUTTON_INTERVAL_MS)
+    {
+        last_button_time = millis();
         check_button();
     }
 
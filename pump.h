@@ -9,4 +9,7 @@ void pump_disable();
 int pump_get_current_mA();
 bool pump_is_on();
 String pump_get_stats_json();
+// Longest time between two pump_handle() calls, i.e. how long dry run
+// protection was blind, since the previous call
+unsigned long pump_get_max_gap_us();
 void pump_handle();
@@ -0,0 +1,151 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct
+{
+    uint16_t tank_level;
+    unsigned long time_stamp;
+    int consumption;
+} sample_t;
+
+// Compact in-RAM ring of samples taken at a fixed cadence.
+// Each record is three zigzag varints relative to the previous sample:
+//   time stamp - (previous time stamp + cadence), usually 0
+//   level - previous level, usually within +-63 per mille
+//   consumption
+// so a typical record is 3-4 bytes instead of the 12 byte sample_t.
+// Records can only be decoded sequentially from the oldest one, which is
+// what the Iterator does. When the buffer is full the oldest records are
+// dropped to make room.
+template <size_t SIZE>
+class SampleRing
+{
+    static const size_t MAX_RECORD_SIZE = 15; // 3 varints of max 5 bytes
+
+    uint8_t buf[SIZE];
+    size_t head = 0; // Byte index of the oldest record
+    size_t used = 0;
+    size_t count = 0;
+    unsigned long cadence;
+    sample_t first_ref; // Reference the oldest record is relative to
+    sample_t last;      // Newest sample, reference for the next record
+
+    static uint32_t zigzag(long value)
+    {
+        return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+    }
+
+    static long unzigzag(uint32_t value)
+    {
+        return (long)(value >> 1) ^ -(long)(value & 1);
+    }
+
+    static size_t put_varint(uint8_t *dst, uint32_t value)
+    {
+        size_t len = 0;
+        while (value >= 0x80)
+        {
+            dst[len++] = (value & 0x7F) | 0x80;
+            value >>= 7;
+        }
+        dst[len++] = value;
+        return len;
+    }
+
+    uint32_t get_varint(size_t &pos) const
+    {
+        uint32_t value = 0;
+        int shift = 0;
+        uint8_t byte;
+        do
+        {
+            byte = buf[pos];
+            pos = (pos + 1) % SIZE;
+            value |= (uint32_t)(byte & 0x7F) << shift;
+            shift += 7;
+        } while ((byte & 0x80) && shift < 35);
+        return value;
+    }
+
+    void decode(size_t &pos, const sample_t &prev, sample_t &sample) const
+    {
+        sample.time_stamp = prev.time_stamp + cadence + unzigzag(get_varint(pos));
+        sample.tank_level = prev.tank_level + unzigzag(get_varint(pos));
+        sample.consumption = unzigzag(get_varint(pos));
+    }
+
+    void drop_oldest()
+    {
+        size_t pos = head;
+        sample_t oldest;
+        decode(pos, first_ref, oldest);
+        used -= (pos + SIZE - head) % SIZE;
+        head = pos;
+        first_ref = oldest;
+        count--;
+    }
+
+public:
+    class Iterator
+    {
+        const SampleRing *ring;
+        size_t pos;
+        size_t left;
+        sample_t prev;
+
+    public:
+        Iterator(const SampleRing *ring) : ring(ring), pos(ring->head), left(ring->count), prev(ring->first_ref){};
+
+        bool next(sample_t &sample)
+        {
+            if (left == 0)
+                return false;
+            ring->decode(pos, prev, sample);
+            prev = sample;
+            left--;
+            return true;
+        }
+    };
+
+    SampleRing(unsigned long cadence_s) : cadence(cadence_s){};
+
+    size_t size() const { return count; }
+    size_t bytes_used() const { return used; }
+    bool isEmpty() const { return count == 0; }
+
+    Iterator begin() const
+    {
+        return Iterator(this);
+    }
+
+    void add(const sample_t &sample)
+    {
+        if (count == 0)
+        {
+            head = 0;
+            used = 0;
+            first_ref = sample;
+            first_ref.time_stamp -= cadence;
+            last = first_ref;
+        }
+
+        uint8_t record[MAX_RECORD_SIZE];
+        size_t len = put_varint(record, zigzag((long)(sample.time_stamp - last.time_stamp - cadence)));
+        len += put_varint(&record[len], zigzag((long)sample.tank_level - (long)last.tank_level));
+        len += put_varint(&record[len], zigzag(sample.consumption));
+
+        while (SIZE - used < len)
+        {
+            drop_oldest();
+        }
+        for (size_t i = 0; i < len; i++)
+        {
+            buf[(head + used + i) % SIZE] = record[i];
+        }
+        used += len;
+        count++;
+        last = sample;
+    }
+};
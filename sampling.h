@@ -0,0 +1,64 @@
+#pragma once
+
+#include <Arduino.h>
+#include "Log.h"
+
+// Chooses between a slow and a fast sample interval. The fast interval is
+// used as soon as the caller reports activity and kept until there has been
+// no activity for hold_ms, so short pauses do not make the rate flap.
+class SamplingPolicy
+{
+    const char *name;
+    unsigned long slow_ms;
+    unsigned long fast_ms;
+    unsigned long hold_ms;
+    unsigned long last_active_ms = 0;
+    unsigned long last_sample_ms = 0;
+    bool fast = false;
+
+    bool take(unsigned long now_ms)
+    {
+        last_sample_ms = now_ms;
+        return true;
+    }
+
+public:
+    SamplingPolicy(const char *name, unsigned long slow_ms, unsigned long fast_ms, unsigned long hold_ms)
+        : name(name), slow_ms(slow_ms), fast_ms(fast_ms), hold_ms(hold_ms){};
+
+    bool is_fast()
+    {
+        return fast;
+    }
+
+    unsigned long interval()
+    {
+        return fast ? fast_ms : slow_ms;
+    }
+
+    // Returns true when a new sample should be taken
+    bool due(bool active)
+    {
+        unsigned long now_ms = millis();
+        if (active)
+        {
+            last_active_ms = now_ms;
+            if (!fast)
+            {
+                fast = true;
+                Log.info("%s sampling: every %lu ms", name, fast_ms);
+                return take(now_ms); // First fast sample right away
+            }
+        }
+        else if (fast && now_ms - last_active_ms > hold_ms)
+        {
+            fast = false;
+            Log.info("%s sampling: every %lu ms", name, slow_ms);
+        }
+        if (now_ms - last_sample_ms < interval())
+        {
+            return false;
+        }
+        return take(now_ms);
+    }
+};
@@ -1,66 +1,140 @@
+#include "server.h"
+
+#if FEATURE_WEB
+
 #include <Arduino.h>
 #include <ESP8266WebServer.h>
+#if FEATURE_SD
 #include <SPI.h>
 #include <SD.h>
+#endif
 #include <TimeLib.h>
 
 #include "Log.h"
-#include "server.h"
+#include "arena.h"
+#include "assets.h"
+#if FEATURE_SD
+#include "history_bin.h"
+#endif
 #include "tank.h"
+#include "telemetry.h"
+#include "wifi_connect.h"
 #include "pump.h"
 
-static ESP8266WebServer server(80);
+#define SERVER_PORT 80
+#define SERVER_MAX_PENDING 4 // Connections queued while another client is served
+#define FILE_CHUNK_SIZE 512
+#define REQUEST_ARENA_SIZE 1024
+
+typedef struct
+{
+    uint32_t free;
+    uint32_t max_block;
+    uint8_t frag;
+} heap_stats_t;
+
+static ESP8266WebServer server(SERVER_PORT);
+
+// Paths, file names and JSON built while handling a request are allocated
+// here instead of as String, and released once the response is sent
+static Arena<REQUEST_ARENA_SIZE> arena;
+static heap_stats_t heap_before; // Around the last completed request
+static heap_stats_t heap_after;
+static uint32_t heap_min_block; // Since server_init()
+
+static void get_heap_stats(heap_stats_t &stats)
+{
+    stats.free = ESP.getFreeHeap();
+    stats.max_block = ESP.getMaxFreeBlockSize();
+    stats.frag = ESP.getHeapFragmentation();
+}
+
+static const char *heap_stats_json(const heap_stats_t &stats)
+{
+    return arena.printf("{\"free\":%u,\"block\":%u,\"frag\":%u}", (unsigned)stats.free, (unsigned)stats.max_block,
+                        stats.frag);
+}
 
-static String getContentType(String filename)
+// Wraps a route handler so the arena is reset after every response
+static ESP8266WebServer::THandlerFunction request(ESP8266WebServer::THandlerFunction handler)
+{
+    return [handler]() {
+        heap_stats_t before;
+        get_heap_stats(before);
+        handler();
+        arena.reset();
+        heap_before = before;
+        get_heap_stats(heap_after);
+        if (heap_after.max_block < heap_min_block)
+        {
+            heap_min_block = heap_after.max_block;
+        }
+    };
+}
+
+static bool endsWith(const char *str, const char *suffix)
+{
+    size_t len = strlen(str);
+    size_t suffix_len = strlen(suffix);
+    return len >= suffix_len && strcmp(&str[len - suffix_len], suffix) == 0;
+}
+
+static const char *getContentType(const char *filename)
 { // convert the file extension to the MIME type
-    if (filename.endsWith(".html"))
+    if (endsWith(filename, ".html"))
         return "text/html";
-    else if (filename.endsWith(".css"))
+    else if (endsWith(filename, ".css"))
         return "text/css";
-    else if (filename.endsWith(".js"))
+    else if (endsWith(filename, ".js"))
         return "application/javascript";
-    else if (filename.endsWith(".ico"))
+    else if (endsWith(filename, ".ico"))
         return "image/x-icon";
-    else if (filename.endsWith(".gz"))
+    else if (endsWith(filename, ".gz"))
         return "application/x-gzip";
     return "text/plain";
 }
 
-static bool sendHistoryJson(String path)
+#if FEATURE_SD
+static void sendJsonArray(File &file)
+{ // Wrap the comma separated records in the file in a JSON array
+    server.setContentLength(CONTENT_LENGTH_UNKNOWN); // Chunked, so the connection can be kept alive
+    server.send(200, "text/json", "[");
+    char buffer[FILE_CHUNK_SIZE];
+    while (file.available())
+    {
+        int len = file.read((uint8_t *)buffer, sizeof(buffer));
+        if (len <= 0)
+        {
+            break;
+        }
+        server.sendContent(buffer, len);
+    }
+    server.sendContent("]");
+    server.sendContent(""); // Terminating chunk
+}
+
+static bool sendHistoryJson(const char *path)
 {
-    if (path.endsWith(".json") && SD.exists(path))
+    if (endsWith(path, ".json") && SD.exists(path))
     {
         File file = SD.open(path, FILE_READ);
         if (file)
         {
-            String header =
-                String("HTTP/1.1 200 OK\r\n") +
-                "Content-Type: text/json\r\n" +
-                "Connection: close\r\n" + // the connection will be closed after completion of the response
-                "\r\n";
-            WiFiClient client = server.client();
-            client.print(header + "[");
-            while (file.available())
-            {
-                client.write(file.read());
-            }
+            sendJsonArray(file);
             file.close();
-            client.print("]");
-            client.flush();
-            client.stop();
             return true;
         }
     }
     return false;
 }
 
-static bool sendLast30daysJson(String path)
+static bool sendLast30daysJson(const char *path)
 {
     bool ret = false;
     String filename;
     int data_offset;
 
-    if (!path.endsWith("last30days.json"))
+    if (!endsWith(path, "last30days.json"))
     {
         return false;
     }
@@ -76,20 +150,7 @@ static bool sendLast30daysJson(String path)
     {
         if (file.seek(data_offset))
         {
-            String header =
-                String("HTTP/1.1 200 OK\r\n") +
-                "Content-Type: text/json\r\n" +
-                "Connection: close\r\n" +
-                "\r\n";
-            WiFiClient client = server.client();
-            client.print(header + "[");
-            while (file.available())
-            {
-                client.write(file.read());
-            }
-            client.print("]");
-            client.flush();
-            client.stop();
+            sendJsonArray(file);
             ret = true;
         }
         else
@@ -107,85 +168,191 @@ static bool sendLast30daysJson(String path)
     return ret;
 }
 
-static bool sendFile(String path)
+static bool sendHistoryBin(const char *path)
+{ // Binary version of a history JSON file, e.g. /2020.bin or /last30days.bin
+    if (!endsWith(path, ".bin"))
+    {
+        return false;
+    }
+    const char *filename = arena.printf("%.*s.json", (int)strlen(path) - 4, path);
+    int data_offset = 0;
+    if (endsWith(path, "last30days.bin"))
+    {
+        String year_file;
+        if (!tank_get_last_30days_file_and_offset(year_file, data_offset))
+        {
+            Log.error("Failed to get 30 days offset");
+            return false;
+        }
+        filename = arena.strdup(year_file.c_str());
+    }
+    if (!SD.exists(filename))
+    {
+        return false;
+    }
+    File file = SD.open(filename, FILE_READ);
+    if (!file)
+    {
+        return false;
+    }
+    server.setContentLength(CONTENT_LENGTH_UNKNOWN);
+    server.send(200, "application/octet-stream", "");
+    history_bin_write(file, data_offset, [](const uint8_t *data, size_t len) {
+        server.sendContent((const char *)data, len);
+    });
+    server.sendContent("");
+    file.close();
+    return true;
+}
+#endif
+
+static bool sendEmbeddedFile(const char *path)
+{
+    const asset_t *asset = assets_find(path);
+    char *etag = asset ? (char *)arena.alloc(strlen_P(asset->etag) + 1) : NULL;
+    if (!etag)
+    {
+        return false;
+    }
+    strcpy_P(etag, asset->etag);
+    server.sendHeader("ETag", etag);
+    server.sendHeader("Cache-Control", "no-cache");
+    if (server.header("If-None-Match") == etag)
+    {
+        server.send(304);
+        return true;
+    }
+    server.sendHeader("Content-Encoding", "gzip");
+    server.send_P(200, asset->content_type, (PGM_P)asset->data, asset->size); // Streamed from flash
+    return true;
+}
+
+static bool sendFile(const char *path)
 { // send the right file to the client (if it exists)
-    Log.info("handleFileRead: %s", path.c_str());
-    if (path.endsWith("/"))
-        path += "index.html";                  // If a folder is requested, send the index file
-    String contentType = getContentType(path); // Get the MIME type
-    String pathWithGz = path + ".gz";
+    Log.info("handleFileRead: %s", path);
+    if (endsWith(path, "/"))
+        path = arena.printf("%sindex.html", path); // If a folder is requested, send the index file
+    if (sendEmbeddedFile(path))
+    {
+        return true;
+    }
+#if FEATURE_SD
     if (sendLast30daysJson(path))
     {
         return true;
     }
+#endif
 
-    if (SPIFFS.exists(pathWithGz) || SPIFFS.exists(path))
-    {                                                       // If the file exists, either as a compressed archive, or normal
-        if (SPIFFS.exists(pathWithGz))                      // If there's a compressed version available
-            path += ".gz";                                  // Use the compressed verion
-        File file = SPIFFS.open(path, "r");                 // Open the file
-        size_t sent = server.streamFile(file, contentType); // Send it to the client
-        file.close();                                       // Close the file again
-        Log.info("Sent file: %s", path.c_str());
+    const char *pathWithGz = arena.printf("%s.gz", path);
+    bool gzExists = SPIFFS.exists(pathWithGz);
+    if (gzExists || SPIFFS.exists(path))
+    {                                                  // If the file exists, either as a compressed archive, or normal
+        const char *contentType = getContentType(path); // Get the MIME type
+        if (gzExists)                                  // If there's a compressed version available
+            path = pathWithGz;                         // Use the compressed verion
+        File file = SPIFFS.open(path, "r");            // Open the file
+        server.streamFile(file, contentType);          // Send it to the client
+        file.close();                                  // Close the file again
+        Log.info("Sent file: %s", path);
         return true;
     }
-    if (sendHistoryJson(path))
+#if FEATURE_SD
+    if (sendHistoryJson(path) || sendHistoryBin(path))
     {
         return true;
     }
-    Log.warn("File Not Found: %s", path.c_str()); // If the file doesn't exist, return false
+#endif
+    Log.warn("File Not Found: %s", path); // If the file doesn't exist, return false
     return false;
 }
 
 void server_init()
 {
     SPIFFS.begin();
+    get_heap_stats(heap_after);
+    heap_before = heap_after;
+    heap_min_block = heap_after.max_block;
+
+    // Core 2.x only collects Authorization by itself, 3.x If-None-Match too,
+    // in a slot ahead of these. So the header is looked up by name.
+    static const char *headerKeys[] = {"If-None-Match"};
+    server.collectHeaders(headerKeys, 1);
 
-    server.onNotFound([]() {                                  // If the client requests any URI
-        if (!sendFile(server.uri()))                          // send it if it exists
+    server.onNotFound(request([]() {                          // If the client requests any URI
+        if (!sendFile(server.uri().c_str()))                  // send it if it exists
             server.send(404, "text/plain", "404: Not Found"); // otherwise, respond with a 404 (Not Found) error
-    });
+    }));
 
-    server.on("/all", HTTP_GET, []() {
-        String json = "{";
-        json += "\"heap\":" + String(ESP.getFreeHeap());
-        json += ", \"analog\":" + String(analogRead(A0));
-        json += ", \"gpio\":" + String((uint32_t)(((GPI | GPO) & 0xFFFF) | ((GP16I & 0x01) << 16)));
-        json += "}";
-        server.send(200, "text/json", json);
-        json = String();
-    });
+    // Heap state now, and before and after the last completed request, and
+    // the longest main loop stall since the previous /all
+    server.on("/all", HTTP_GET, request([]() {
+        heap_stats_t heap;
+        get_heap_stats(heap);
+        const char *json = arena.printf(
+            "{\"heap\":%u, \"heap_block\":%u, \"heap_frag\":%u, \"heap_min_block\":%u, \"heap_before\":%s, "
+            "\"heap_after\":%s, \"arena_peak\":%u, \"arena_failures\":%lu, \"analog\":%d, \"gpio\":%u, "
+            "\"pump_gap_us\":%lu, \"telemetry\":%s, \"wifi\":%s}",
+            (unsigned)heap.free, (unsigned)heap.max_block, heap.frag, (unsigned)heap_min_block,
+            heap_stats_json(heap_before), heap_stats_json(heap_after), (unsigned)arena.get_peak(),
+            arena.get_failures(), analogRead(A0), (unsigned)(((GPI | GPO) & 0xFFFF) | ((GP16I & 0x01) << 16)),
+            pump_get_max_gap_us(), telemetry_get_stats_json().c_str(), wifi_get_stats_json().c_str());
+        server.send(200, "text/json", json, strlen(json));
+    }));
 
-    server.on("/time", HTTP_GET, []() {
-        String json = "{";
-        json += "\"epoch\":" + String(now());
-        json += "}";
-        server.send(200, "text/json", json);
-        json = String();
-    });
+    server.on("/time", HTTP_GET, request([]() {
+        const char *json = arena.printf("{\"epoch\":%lu}", (unsigned long)now());
+        server.send(200, "text/json", json, strlen(json));
+    }));
 
-    server.on("/stats.json", HTTP_GET, []() {
+    server.on("/stats.json", HTTP_GET, request([]() {
         String json = "{\"TANK\":" + tank_get_stats_json();
         json += ",\"PUMP\":" + pump_get_stats_json() + "}";
         server.send(200, "text/json", json);
-    });
+    }));
 
-    server.on("/24h_history.json", HTTP_GET, []() {
+    server.on("/24h_history.json", HTTP_GET, request([]() {
         server.send(200, "text/json", tank_get_last_24h_json());
-    });
+    }));
+
+    // Samples from the in-RAM history, e.g. /range.json?res=minute&from=1594512000
+    server.on("/range.json", HTTP_GET, request([]() {
+        bool per_minute = server.arg("res") == "minute";
+        unsigned long from = server.hasArg("from") ? strtoul(server.arg("from").c_str(), NULL, 10) : 0;
+        unsigned long to = server.hasArg("to") ? strtoul(server.arg("to").c_str(), NULL, 10) : ULONG_MAX;
+        server.setContentLength(CONTENT_LENGTH_UNKNOWN);
+        server.send(200, "text/json", "");
+        tank_write_range_json(per_minute, from, to, [](const String &chunk) {
+            server.sendContent(chunk);
+        });
+        server.sendContent("");
+    }));
 
-    server.on("/enable_pump", HTTP_POST, []() {
+#ifdef LOG_USE_BINARY
+    server.on("/logs", HTTP_GET, request([]() {
+        server.setContentLength(CONTENT_LENGTH_UNKNOWN);
+        server.send(200, "text/plain", "");
+        Log.dump([](const char *line, size_t len) {
+            server.sendContent(line, len); // One chunk per line
+        });
+        server.sendContent("");
+    }));
+#endif
+
+    server.on("/enable_pump", HTTP_POST, request([]() {
         server.send(200, "text/plain", "Post route");
         pump_enable();
-    });
+    }));
 
-    server.on("/disable_pump", HTTP_POST, []() {
+    server.on("/disable_pump", HTTP_POST, request([]() {
         server.send(200, "text/plain", "Post route");
         pump_disable();
-    });
+    }));
 
-    // Start the server
-    server.begin();
+    // Start the server. HTTP/1.1 clients are kept alive by ESP8266WebServer
+    // until they have been idle for HTTP_MAX_CLOSE_WAIT or another client
+    // is waiting. Further connections are refused once the backlog is full.
+    server.getServer().begin(SERVER_PORT, SERVER_MAX_PENDING);
+    server.getServer().setNoDelay(true);
     Log.info("Server started");
 }
 
@@ -193,3 +360,5 @@ void server_handle()
 {
     server.handleClient();
 }
+
+#endif
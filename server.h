@@ -1,4 +1,11 @@
 #pragma once
 
+#include "feature_config.h"
+
+#if FEATURE_WEB
 void server_init();
-void server_handle();
\ No newline at end of file
+void server_handle();
+#else
+inline void server_init() {}
+inline void server_handle() {}
+#endif
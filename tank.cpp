@@ -1,19 +1,28 @@
+#include "feature_config.h"
+
+#if FEATURE_TANK
+
 #include <Arduino.h>
+#if FEATURE_SD
 #include <SPI.h>
 #include <SD.h>
-#include <RingBufCPP.h>
+#endif
 #include <TimeLib.h>
-#include "MedianFilterLib.h"
-#include "MeanFilterLib.h"
 
 #include "Log.h"
 #include "pins.h"
 #include "tank.h"
+#include "trace.h"
+#include "telemetry.h"
 #include "consumption.h"
+#include "flow.h"
+#include "sample_ring.h"
+#include "sampling.h"
+#include "level_estimator.h"
 
 #define MIN(x, y) (((x) < (y)) ? (x) : (y))
-#define SLOW_MEAN_FILTER_LEN 8
-#define FAST_MEDIAN_FILTER_LEN 5
+#define LEVEL_SETTLE_SAMPLES 3 // Estimator updates before the level is trusted
+#define SAMPLE_BURST_LEN 5
 
 #define TANK_HEIGHT_MM 920
 #define TANK_TOP_DISTANCE_MM 40
@@ -21,27 +30,49 @@
 #define MINUTE minute
 #define HOUR hour
 
-typedef struct
-{
-    uint16_t tank_level;
-    unsigned long time_stamp;
-    int consumption;
-} sample_t;
+// Sample history in RAM, about 3 bytes per sample. Together the default
+// sizes take 5.6 KiB of static RAM, where the old 24 entry hourly buffer
+// took 288 bytes: a day of per minute samples does not fit in that. Set
+// smaller sizes in settings.h to keep less minute history and more heap.
+#ifndef HISTORY_HOURLY_RING_SIZE
+#define HISTORY_HOURLY_RING_SIZE 1024 // ~8 days of hourly samples
+#endif
+#ifndef HISTORY_MINUTE_RING_SIZE
+#define HISTORY_MINUTE_RING_SIZE 4608 // ~25 hours of per minute samples
+#endif
+
+// Level is sampled every minute, and every 10 s while the pump runs or the
+// level changes faster than LEVEL_FAST_RATE per mille/h
+#define LEVEL_SLOW_INTERVAL_MS 60000
+#define LEVEL_FAST_INTERVAL_MS 10000
+#define LEVEL_FAST_HOLD_MS (5 * 60000)
+#define LEVEL_FAST_RATE 30
+#define LEVEL_ACTIVITY_CHECK_MS 1000
+
+#define SECONDS_PER_DAY (24 * 3600UL)
+#define RANGE_CHUNK_SIZE 512
 
 static Consumption consumption_per_day;
 static Consumption consumption_per_hour;
+static Consumption consumption_per_minute;
+static FlowMonitor flow;
 static int last_hour;
 static int last_min;
-static RingBufCPP<sample_t, 24> last24hSamples;
+static SampleRing<HISTORY_HOURLY_RING_SIZE> hourly_samples(3600);
+static SampleRing<HISTORY_MINUTE_RING_SIZE> minute_samples(60);
+#if FEATURE_SD
 static int last_30days_offset = -1;
+#endif
 
-static MeanFilter<long> meanFilter(SLOW_MEAN_FILTER_LEN);
+static LevelEstimator levelEstimator;
+static SamplingPolicy level_sampling("Level", LEVEL_SLOW_INTERVAL_MS, LEVEL_FAST_INTERVAL_MS, LEVEL_FAST_HOLD_MS);
 
-static String sample_to_json(sample_t &sample)
+static String sample_to_json(const sample_t &sample)
 {
     return "{\"LVL\":" + String(sample.tank_level) + ",\"TS\":" + String(sample.time_stamp) + ",\"CONS\":" + String(sample.consumption) + "}";
 }
 
+#if FEATURE_SD
 static String year_file_path()
 {
     char filename[32];
@@ -138,36 +169,35 @@ static void store_sample(String path, sample_t &sample)
         Log.error("Failed to open: %s", path.c_str());
     }
 }
+#endif
 
 static bool take_sample()
 {
-    static int filter_entries = 0;
-    MedianFilter<long> fastMedianFilter(FAST_MEDIAN_FILTER_LEN);
-    for (int i = 0; i < FAST_MEDIAN_FILTER_LEN; i++)
+    long durations[SAMPLE_BURST_LEN];
+    for (int i = 0; i < SAMPLE_BURST_LEN; i++)
     {
         digitalWrite(DIST_TRIG_PIN, HIGH);
         delayMicroseconds(10);
         digitalWrite(DIST_TRIG_PIN, LOW);
         long duration = pulseIn(DIST_ECHO_PIN, HIGH);
-        fastMedianFilter.AddValue(duration);
+        trace_record(TraceEcho, duration);
         if (duration == 0)
         {
             // Unable to get sensor value
             Log.warn("Unable to get distance value");
-            break;
+            return levelEstimator.count() >= LEVEL_SETTLE_SAMPLES;
         }
+        durations[i] = duration;
     }
-    meanFilter.AddValue(fastMedianFilter.GetFiltered());
-    if (filter_entries < SLOW_MEAN_FILTER_LEN)
+    long median, spread;
+    level_burst_stats(durations, SAMPLE_BURST_LEN, median, spread);
+    levelEstimator.add(median, spread, millis());
+    if (levelEstimator.count() >= LEVEL_SETTLE_SAMPLES)
     {
-        filter_entries++;
-    }
-    if (filter_entries == SLOW_MEAN_FILTER_LEN)
-    {
-        Log.info("Take sample (filled)");
+        Log.info("Take sample (settled)");
         return true;
     }
-    Log.info("Take sample (filling)");
+    Log.info("Take sample (settling)");
     return false;
 }
 
@@ -177,13 +207,13 @@ void tank_init()
     last_hour = hour();
     last_min = minute();
 
-    // Take one sample to avoid div by zero in mean filter
+    // Start the level estimate right away
     take_sample();
 }
 
 uint16 tank_get_level()
 {
-    long distance_mm = (meanFilter.GetFiltered() * 34) / 200; // org: (0.034 / 2)
+    long distance_mm = (levelEstimator.get() * 34) / 200; // org: (0.034 / 2)
     distance_mm -= TANK_TOP_DISTANCE_MM;
     if (distance_mm < 0)
         distance_mm = 0;
@@ -195,34 +225,86 @@ String tank_get_stats_json()
 {
     int diff = 0;
     uint16_t level = tank_get_level();
-    if (!last24hSamples.isEmpty())
+    sample_t old_sample;
+    SampleRing<HISTORY_HOURLY_RING_SIZE>::Iterator it = hourly_samples.begin();
+    while (it.next(old_sample))
     {
-        sample_t *old_sample = last24hSamples.peek(0);
-        diff = level - old_sample->tank_level;
+        if (old_sample.time_stamp + SECONDS_PER_DAY >= (unsigned long)now())
+        {
+            diff = level - old_sample.tank_level;
+            break;
+        }
     }
     int consumed = consumption_per_day.get_consumption(false);
     int harvest = diff + consumed;
 
-    return "{\"LVL\":" + String(level) + ",\"HARV\":" + String(harvest) + ",\"CONS\":" + String(consumed) + "}";
+    return "{\"LVL\":" + String(level) + ",\"HARV\":" + String(harvest) + ",\"CONS\":" + String(consumed) +
+           ",\"FLOW\":" + flow.get_stats_json() + "}";
 }
 
 String tank_get_last_24h_json()
 {
-    int i = 0;
     String json;
-    sample_t *sample = last24hSamples.peek(i);
-    while (sample)
+    unsigned long since = (unsigned long)now() - SECONDS_PER_DAY;
+    sample_t sample;
+    SampleRing<HISTORY_HOURLY_RING_SIZE>::Iterator it = hourly_samples.begin();
+    while (it.next(sample))
     {
-        json += sample_to_json(*sample);
-        sample = last24hSamples.peek(++i);
-        if (sample)
+        if (sample.time_stamp < since)
+        {
+            continue;
+        }
+        if (json.length() > 0)
         {
             json += ",";
         }
+        json += sample_to_json(sample);
     }
     return "[" + json + "]";
 }
 
+template <size_t SIZE>
+static void write_range_json(SampleRing<SIZE> &ring, unsigned long from, unsigned long to, json_writer_t write)
+{
+    String chunk = "[";
+    bool first = true;
+    sample_t sample;
+    typename SampleRing<SIZE>::Iterator it = ring.begin();
+    while (it.next(sample))
+    {
+        if (sample.time_stamp < from || sample.time_stamp > to)
+        {
+            continue;
+        }
+        if (!first)
+        {
+            chunk += ",";
+        }
+        first = false;
+        chunk += sample_to_json(sample);
+        if (chunk.length() > RANGE_CHUNK_SIZE)
+        {
+            write(chunk);
+            chunk = "";
+        }
+    }
+    chunk += "]";
+    write(chunk);
+}
+
+void tank_write_range_json(bool per_minute, unsigned long from, unsigned long to, json_writer_t write)
+{
+    if (per_minute)
+    {
+        write_range_json(minute_samples, from, to, write);
+    }
+    else
+    {
+        write_range_json(hourly_samples, from, to, write);
+    }
+}
+
+#if FEATURE_SD
 bool tank_get_last_30days_file_and_offset(String &filename, int &data_offset)
 {
     if (last_30days_offset == -1)
@@ -233,27 +315,46 @@ bool tank_get_last_30days_file_and_offset(String &filename, int &data_offset)
     data_offset = last_30days_offset;
     return true;
 }
+#endif
 
 void tank_handle()
 {
     static bool filling = true;
+    static bool active = false;
+    static unsigned long last_activity_check = 0;
 
-    if (last_min == MINUTE())
+    // The rate fit and the pump current median are too costly for every
+    // loop, and samples are at least 10 s apart anyway
+    if (millis() - last_activity_check >= LEVEL_ACTIVITY_CHECK_MS)
     {
-        return;
+        last_activity_check = millis();
+        int rate = flow.get_rate();
+        active = pump_is_on() || rate > LEVEL_FAST_RATE || rate < -LEVEL_FAST_RATE;
+    }
+    if (level_sampling.due(active))
+    {
+        bool filter_filled = take_sample();
+        if (filling && filter_filled)
+        {
+            filling = false;
+            last_hour = HOUR();
+        }
     }
-    last_min = MINUTE();
 
-    bool filter_filled = take_sample();
-    if (filling && filter_filled)
+    if (last_min == MINUTE())
     {
-        filling = false;
-        last_hour = HOUR();
+        return;
     }
+    last_min = MINUTE();
 
     // Update consumption states each min
     consumption_per_hour.tick();
     consumption_per_day.tick();
+    consumption_per_minute.tick();
+    if (!filling)
+    {
+        flow.tick();
+    }
 
     if (year() < 2000)
     {
@@ -262,6 +363,7 @@ void tank_handle()
         return;
     }
 
+#if FEATURE_SD
     // Now when we got the NTP time we need to update 30 day history context once
     static bool last_30days_updated = false;
     if (!last_30days_updated)
@@ -269,8 +371,21 @@ void tank_handle()
         update_last_30days();
         last_30days_updated = true;
     }
+#endif
+
+    if (filling)
+    {
+        return;
+    }
+
+    sample_t minute_sample = {
+        .tank_level = tank_get_level(),
+        .time_stamp = (unsigned long)now(),
+        .consumption = consumption_per_minute.get_consumption()};
+    minute_samples.add(minute_sample);
+    telemetry_sample(minute_sample.time_stamp, minute_sample.tank_level, minute_sample.consumption, flow.get_rate());
 
-    if (last_hour != HOUR() && !filling)
+    if (last_hour != HOUR())
     {
         last_hour = HOUR();
         uint16_t level = tank_get_level();
@@ -280,21 +395,20 @@ void tank_handle()
 
         Log.info("Sample, lvl: %d", sample.tank_level);
 
-        if (last24hSamples.isFull())
-        {
-            sample_t dummy;
-            last24hSamples.pull(&dummy);
-        }
         sample.consumption = consumption_per_hour.get_consumption();
-        last24hSamples.add(sample);
+        hourly_samples.add(sample);
 
         if (last_hour == 23)
         {
+            sample.consumption = consumption_per_day.get_consumption(); // Also starts the next day
+#if FEATURE_SD
             Log.info("Writing sample to SD card");
-            sample.consumption = consumption_per_day.get_consumption();
             store_sample(year_file_path(), sample);
             store_sample(month_file_path(), sample);
             update_last_30days();
+#endif
         }
     }
 }
+
+#endif
@@ -1,10 +1,22 @@
 #pragma once
 
 #include <stdint.h>
+#include <functional>
+#include "feature_config.h"
 
+typedef std::function<void(const String &)> json_writer_t;
+
+#if FEATURE_TANK
 void tank_init();
 uint16 tank_get_level(); // Returns level in per mille
 String tank_get_stats_json();
 String tank_get_last_24h_json();
+void tank_write_range_json(bool per_minute, unsigned long from, unsigned long to, json_writer_t write);
+#if FEATURE_SD
 bool tank_get_last_30days_file_and_offset(String &filename, int &data_offset);
+#endif
 void tank_handle();
+#else
+inline void tank_init() {}
+inline void tank_handle() {}
+#endif
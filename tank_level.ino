@@ -1,11 +1,23 @@
+#include "feature_config.h" // Includes settings.h, create it from settings.template
+
+#if FEATURE_WIFI
 #include <ESP8266WiFi.h>
+#endif
+#if FEATURE_MDNS
 #include <ESP8266mDNS.h>
+#endif
+#if FEATURE_OTA
 #include <ArduinoOTA.h>
+#endif
+#if FEATURE_NTP
 #include <NTPClient.h>
 #include <WiFiUdp.h>
+#endif
 
+#if FEATURE_SD
 #include <SPI.h>
 #include <SD.h>
+#endif
 #include <TimeLib.h>
 #include "MedianFilterLib.h"
 
@@ -14,34 +26,17 @@
 #include "tank.h"
 #include "server.h"
 #include "pump.h"
+#include "trace.h"
+#include "telemetry.h"
+#include "wifi_connect.h"
 
-#include "settings.h" // Create from settings.template
-
+#if FEATURE_NTP
 static WiFiUDP ntpUDP;
 
 NTPClient timeClient(ntpUDP, NTP_SERVER, NTP_CLOCK_OFFSET, 60000);
+#endif
 
-static void setupWifi()
-{
-  WiFi.disconnect();
-  Serial.printf("Connecting WiFi to \"%s\"", WIFI_SSID);
-
-  WiFi.mode(WIFI_STA);
-  //WiFi.softAPdisconnect();
-
-  WiFi.onStationModeConnected([](const WiFiEventStationModeConnected &event) {
-    Serial.printf("WiFi connected, RSSI: %d dBm", WiFi.RSSI());
-  });
-
-  WiFi.onStationModeGotIP([](const WiFiEventStationModeGotIP &event) {
-    Serial.printf("WiFi got IP, RSSI: %d dBm", WiFi.RSSI());
-  });
-
-  WiFi.begin(WIFI_SSID, WIFI_PASSKEY);
-  WiFi.setAutoConnect(true);
-  WiFi.setAutoReconnect(true);
-}
-
+#if FEATURE_OTA
 static void setupOta()
 {
   ArduinoOTA.setHostname("tank");
@@ -89,7 +84,9 @@ static void setupOta()
   });
   ArduinoOTA.begin();
 }
+#endif
 
+#if FEATURE_NTP
 static void handleNtp()
 {
   static long last_time = 0;
@@ -107,6 +104,7 @@ static void handleNtp()
     setTime(timeClient.getEpochTime());
   }
 }
+#endif
 
 void setup()
 {
@@ -124,39 +122,58 @@ void setup()
   Log.begin();
 
   // Connect to WiFi network
-  setupWifi();
+  wifi_init();
 
+#if FEATURE_SD
   Log.info("Initializing SD card...");
   if (SD.begin(SDCARD_CS_PIN))
   {
     Log.info("initialization done.");
+    Log.beginRing();
+    trace_init();
   }
   else
   {
     Log.error("initialization failed!");
   }
+#endif
 
+#if FEATURE_MDNS
   if (!MDNS.begin("tank"))
   {
     Log.error("Error setting up MDNS responder!");
   }
   MDNS.addService("http", "tcp", 80);
+#endif
 
   Log.info("Free stack: %d", ESP.getFreeContStack());
 
+#if FEATURE_OTA
   setupOta();
+#endif
 
   tank_init();
   pump_init();
   server_init();
+  telemetry_init();
 }
 
 void loop()
 {
+  wifi_handle();
+#if FEATURE_MDNS
   MDNS.update();
+#endif
+#if FEATURE_OTA
   ArduinoOTA.handle();
+#endif
+#if FEATURE_NTP
   handleNtp();
+#endif
   tank_handle();
   server_handle();
   pump_handle();
+  trace_handle();
+  telemetry_handle();
+  Log.handle();
 }
@@ -0,0 +1,508 @@
+// Publishes samples, pump events and system metrics to a collector as
+// InfluxDB line protocol, e.g.
+//   tank level=523i,consumption=3i,rate=-12i 1594512000
+//   pump,state=Running current=4120i 1594512042
+//   tank_sys heap=23120i,rssi=-61i,uptime=3600i,queued=96i,spill=0i,dropped=0i 1594512060
+// Time stamps are in seconds, so the collector must use 1 s precision.
+// Lines created before the NTP time is known have no time stamp.
+//
+// Lines are queued in RAM and sent in batches over one persistent TCP
+// connection, either raw (e.g. to a Telegraf socket_listener) or, with
+// TELEMETRY_MQTT_TOPIC, as QoS 1 MQTT publishes. One batch is in flight at
+// a time and is only removed once it is confirmed: by PUBACK over MQTT, or
+// by the send buffer draining (all bytes acked by the peer) over raw TCP.
+// A batch lost with the connection is sent again after reconnecting, so
+// the collector may see a line twice, which InfluxDB stores as one point.
+//
+// Only connecting blocks, as WiFiClient::connect() waits for the
+// handshake: for up to TELEMETRY_CONNECT_TIMEOUT_MS, plus up to
+// TELEMETRY_DNS_TIMEOUT_MS when the server name is resolved again after a
+// failed attempt. Attempts back off to one per TELEMETRY_RETRY_MAX_MS, so
+// an unreachable collector stalls loop() that long about once a minute. A
+// batch is only written when the socket has room for it. When the queue is
+// full, e.g. while the collector is unreachable, it is spilled to
+// TELEMETRY_SPILL_FILE on SD. The spill is sent, oldest first, before the
+// queue once the connection is back. Lines are only dropped when the spill
+// file is full or there is no SD card.
+#include "telemetry.h"
+
+#ifdef TELEMETRY_SERVER
+
+#include <Arduino.h>
+#include <ESP8266WiFi.h>
+#if FEATURE_SD
+#include <SD.h>
+#endif
+#include <TimeLib.h>
+
+#include "Log.h"
+
+#ifndef TELEMETRY_PORT
+#ifdef TELEMETRY_MQTT_TOPIC
+#define TELEMETRY_PORT 1883
+#else
+#define TELEMETRY_PORT 8094
+#endif
+#endif
+#ifndef TELEMETRY_MQTT_CLIENT_ID
+#define TELEMETRY_MQTT_CLIENT_ID "tank"
+#endif
+#ifndef TELEMETRY_SPILL_MAX_SIZE
+#define TELEMETRY_SPILL_MAX_SIZE (1024UL * 1024)
+#endif
+
+#define TELEMETRY_QUEUE_SIZE 1024
+#define TELEMETRY_BATCH_SIZE 512 // Max payload of one write or publish
+#define TELEMETRY_MAX_LINE 128
+#define TELEMETRY_FLUSH_INTERVAL_MS 10000
+#define TELEMETRY_METRICS_INTERVAL_MS 60000
+#define TELEMETRY_CONNECT_TIMEOUT_MS 100 // A collector on the LAN answers in a few ms
+#define TELEMETRY_DNS_TIMEOUT_MS 500
+#define TELEMETRY_ACK_TIMEOUT_MS 10000 // For CONNACK, PUBACK or the send buffer to drain
+#define TELEMETRY_RETRY_MIN_MS 1000
+#define TELEMETRY_RETRY_MAX_MS 60000
+#define TELEMETRY_MQTT_KEEPALIVE_S 60
+#define TELEMETRY_SPILL_FILE "/telemetry.spl"
+
+#define MIN(x, y) (((x) < (y)) ? (x) : (y))
+
+static WiFiClient client;
+static IPAddress server_ip;
+static bool server_resolved;
+static char queue[TELEMETRY_QUEUE_SIZE];
+static size_t queue_len;
+static bool spill_pending;
+static size_t spill_offset;  // Bytes of the spill file already confirmed
+static size_t in_flight;     // Bytes of the batch waiting for confirmation
+static bool in_flight_spill; // The batch came from the spill file
+static unsigned long in_flight_ms;
+static bool connected;  // Ready to send, for MQTT after CONNACK
+static bool connecting; // MQTT CONNECT sent, waiting for CONNACK
+static int idle_send_buffer;
+static unsigned long last_flush_ms;
+static unsigned long last_metrics_ms;
+static unsigned long last_send_ms;
+static unsigned long retry_ms = TELEMETRY_RETRY_MIN_MS;
+static unsigned long sent_bytes;
+static unsigned long spilled_bytes;
+static unsigned long dropped;
+static unsigned long connects;
+
+static void disconnect(const char *reason)
+{
+    if (connected)
+    {
+        Log.warn("Telemetry disconnected: %s", reason);
+    }
+    client.stop();
+    connected = false;
+    connecting = false;
+    in_flight = 0; // Sent again on the next connection
+}
+
+static void on_connected()
+{
+    connected = true;
+    connecting = false;
+    connects++;
+    retry_ms = TELEMETRY_RETRY_MIN_MS;
+    last_send_ms = millis();
+    Log.info("Telemetry connected to %s:%d", TELEMETRY_SERVER, TELEMETRY_PORT);
+}
+
+static bool write_all(const uint8_t *data, size_t len)
+{
+    if (client.write(data, len) != len)
+    {
+        disconnect("write failed");
+        return false;
+    }
+    last_send_ms = millis();
+    return true;
+}
+
+// Removes the confirmed batch from the spill file or the queue
+static void confirm()
+{
+    sent_bytes += in_flight;
+    if (in_flight_spill)
+    {
+        spill_offset += in_flight;
+    }
+    else
+    {
+        queue_len -= in_flight;
+        memmove(queue, &queue[in_flight], queue_len);
+    }
+    in_flight = 0;
+}
+
+#ifdef TELEMETRY_MQTT_TOPIC
+static unsigned long connect_ms;
+static uint16_t packet_id;
+
+static size_t put_length(uint8_t *dst, size_t value)
+{ // MQTT remaining length, 7 bits per byte
+    size_t len = 0;
+    do
+    {
+        dst[len] = value & 0x7F;
+        value >>= 7;
+        if (value)
+        {
+            dst[len] |= 0x80;
+        }
+        len++;
+    } while (value);
+    return len;
+}
+
+static size_t put_string(uint8_t *dst, const char *str)
+{
+    size_t len = strlen(str);
+    dst[0] = len >> 8;
+    dst[1] = len & 0xFF;
+    memcpy(&dst[2], str, len);
+    return len + 2;
+}
+
+static void mqtt_connect()
+{
+    uint8_t body[128];
+    static const uint8_t protocol[] = {0, 4, 'M', 'Q', 'T', 'T', 4};
+    memcpy(body, protocol, sizeof(protocol));
+    size_t len = sizeof(protocol);
+    uint8_t &flags = body[len++];
+    flags = 0x02; // Clean session
+    body[len++] = TELEMETRY_MQTT_KEEPALIVE_S >> 8;
+    body[len++] = TELEMETRY_MQTT_KEEPALIVE_S & 0xFF;
+    len += put_string(&body[len], TELEMETRY_MQTT_CLIENT_ID);
+#ifdef TELEMETRY_MQTT_USER
+    flags |= 0x80;
+    len += put_string(&body[len], TELEMETRY_MQTT_USER);
+#ifdef TELEMETRY_MQTT_PASSWORD
+    flags |= 0x40;
+    len += put_string(&body[len], TELEMETRY_MQTT_PASSWORD);
+#endif
+#endif
+    uint8_t header[5] = {0x10};
+    size_t header_len = 1 + put_length(&header[1], len);
+    if (write_all(header, header_len) && write_all(body, len))
+    {
+        connecting = true;
+        connect_ms = millis();
+    }
+}
+
+// Handles CONNACK, PUBACK and PINGRESP, which all fit in 4 bytes
+static void mqtt_handle()
+{
+    uint8_t packet[4];
+    while (client.available() >= 2 && client.peekBytes(packet, 2) == 2 && client.available() >= 2 + packet[1])
+    {
+        size_t len = 2 + packet[1];
+        if (len > sizeof(packet))
+        {
+            disconnect("unexpected packet");
+            return;
+        }
+        client.read(packet, len);
+        switch (packet[0])
+        {
+        case 0x20: // CONNACK
+            if (len == 4 && packet[3] == 0)
+            {
+                on_connected();
+            }
+            else
+            {
+                Log.error("Telemetry broker refused connection: %d", packet[3]);
+                disconnect("refused");
+                return;
+            }
+            break;
+        case 0x40: // PUBACK
+            if (in_flight && len == 4 && (packet[2] << 8 | packet[3]) == packet_id)
+            {
+                confirm();
+            }
+            break;
+        }
+    }
+    if (connecting && millis() - connect_ms > TELEMETRY_ACK_TIMEOUT_MS)
+    {
+        Log.warn("Telemetry broker did not answer");
+        disconnect("no CONNACK");
+    }
+    if (connected && millis() - last_send_ms > TELEMETRY_MQTT_KEEPALIVE_S * 1000UL / 2 &&
+        client.availableForWrite() >= 2)
+    {
+        static const uint8_t ping[] = {0xC0, 0};
+        write_all(ping, sizeof(ping));
+    }
+}
+#endif
+
+// Sends one batch of whole lines if the socket has room for it
+static bool send(const char *data, size_t len, bool from_spill)
+{
+#ifdef TELEMETRY_MQTT_TOPIC
+    uint8_t header[5 + 2 + sizeof(TELEMETRY_MQTT_TOPIC) + 2] = {0x32}; // PUBLISH, QoS 1
+    size_t topic_len = sizeof(TELEMETRY_MQTT_TOPIC) - 1;
+    size_t header_len = 1 + put_length(&header[1], 2 + topic_len + 2 + len);
+    header_len += put_string(&header[header_len], TELEMETRY_MQTT_TOPIC);
+    uint16_t id = packet_id == 0xFFFF ? 1 : packet_id + 1;
+    header[header_len++] = id >> 8;
+    header[header_len++] = id & 0xFF;
+    if ((size_t)client.availableForWrite() < header_len + len || !write_all(header, header_len))
+    {
+        return false;
+    }
+    packet_id = id;
+#else
+    if ((size_t)client.availableForWrite() < len)
+    {
+        return false;
+    }
+#endif
+    if (!write_all((const uint8_t *)data, len))
+    {
+        return false;
+    }
+    in_flight = len;
+    in_flight_spill = from_spill;
+    in_flight_ms = millis();
+    return true;
+}
+
+// Length of the longest run of whole lines that fits in a batch
+static size_t batch_len(const char *data, size_t len)
+{
+    len = MIN(len, (size_t)TELEMETRY_BATCH_SIZE);
+    while (len > 0 && data[len - 1] != '\n')
+    {
+        len--;
+    }
+    return len;
+}
+
+static void spill()
+{
+#if FEATURE_SD
+    File file = SD.open(TELEMETRY_SPILL_FILE, FILE_WRITE);
+    if (!file)
+    {
+        return;
+    }
+    if (file.size() + queue_len <= TELEMETRY_SPILL_MAX_SIZE)
+    {
+        if (!spill_pending)
+        {
+            Log.info("Spilling telemetry to %s", TELEMETRY_SPILL_FILE);
+        }
+        file.write((const uint8_t *)queue, queue_len);
+        spilled_bytes += queue_len;
+        spill_pending = true;
+        queue_len = 0;
+        // The queue is only sent when the spill is empty, so a batch in
+        // flight from the queue is now at the start of the spill
+        in_flight_spill = true;
+    }
+    file.close();
+#endif
+}
+
+static void send_spill()
+{
+#if FEATURE_SD
+    File file = SD.open(TELEMETRY_SPILL_FILE, FILE_READ);
+    if (!file)
+    {
+        spill_pending = false;
+        return;
+    }
+    size_t size = file.size();
+    if (spill_offset >= size)
+    {
+        file.close();
+        SD.remove(TELEMETRY_SPILL_FILE);
+        Log.info("Telemetry spill of %d bytes sent", (int)size);
+        spill_offset = 0;
+        spill_pending = false;
+        return;
+    }
+    char batch[TELEMETRY_BATCH_SIZE];
+    if (client.availableForWrite() >= TELEMETRY_BATCH_SIZE && file.seek(spill_offset))
+    {
+        int n = file.read((uint8_t *)batch, sizeof(batch));
+        size_t len = n > 0 ? batch_len(batch, n) : 0;
+        if (len > 0)
+        {
+            send(batch, len, true);
+        }
+    }
+    file.close();
+#endif
+}
+
+static void enqueue(const char *line, size_t len)
+{
+    if (queue_len + len > TELEMETRY_QUEUE_SIZE)
+    {
+        spill();
+    }
+    if (queue_len + len > TELEMETRY_QUEUE_SIZE)
+    {
+        if (dropped++ % 100 == 0)
+        {
+            Log.warn("Telemetry queue full, %lu lines dropped", dropped);
+        }
+        return;
+    }
+    memcpy(&queue[queue_len], line, len);
+    queue_len += len;
+}
+
+// Completes a line formatted into buffer with a time stamp and queues it
+static void add_line(char *line, int len, unsigned long time_stamp)
+{
+    if (len <= 0 || len >= TELEMETRY_MAX_LINE - 12)
+    {
+        Log.error("Telemetry line too long");
+        return;
+    }
+    if (time_stamp)
+    {
+        len += snprintf(&line[len], TELEMETRY_MAX_LINE - len, " %lu", time_stamp);
+    }
+    line[len++] = '\n';
+    enqueue(line, len);
+}
+
+static void connect()
+{
+    static unsigned long last_attempt_ms;
+    if (WiFi.status() != WL_CONNECTED || millis() - last_attempt_ms < retry_ms)
+    {
+        return;
+    }
+    last_attempt_ms = millis();
+    // Resolved here rather than by connect(), which would wait up to 10 s
+    if (!server_resolved && !WiFi.hostByName(TELEMETRY_SERVER, server_ip, TELEMETRY_DNS_TIMEOUT_MS))
+    {
+        retry_ms = MIN(retry_ms * 2, (unsigned long)TELEMETRY_RETRY_MAX_MS);
+        return;
+    }
+    server_resolved = true;
+    client.setTimeout(TELEMETRY_CONNECT_TIMEOUT_MS);
+    if (!client.connect(server_ip, TELEMETRY_PORT))
+    {
+        server_resolved = false; // The address may have changed
+        retry_ms = MIN(retry_ms * 2, (unsigned long)TELEMETRY_RETRY_MAX_MS);
+        return;
+    }
+    client.setNoDelay(true);
+    idle_send_buffer = client.availableForWrite();
+#ifdef TELEMETRY_MQTT_TOPIC
+    mqtt_connect();
+#else
+    on_connected();
+#endif
+}
+
+static void add_metrics()
+{
+    char line[TELEMETRY_MAX_LINE];
+    int len = snprintf(line, sizeof(line), "tank_sys heap=%ui,rssi=%di,uptime=%lui,queued=%ui,spill=%lui,dropped=%lui",
+                       (unsigned)ESP.getFreeHeap(), WiFi.RSSI(), millis() / 1000, (unsigned)queue_len, spilled_bytes,
+                       dropped);
+    add_line(line, len, year() >= 2000 ? now() : 0);
+}
+
+void telemetry_init()
+{
+#if FEATURE_SD
+    spill_pending = SD.exists(TELEMETRY_SPILL_FILE);
+#endif
+    if (spill_pending)
+    {
+        Log.info("Telemetry spill from previous run pending");
+    }
+    last_metrics_ms = millis();
+}
+
+void telemetry_sample(unsigned long time_stamp, uint16_t level, int consumption, int rate)
+{
+    char line[TELEMETRY_MAX_LINE];
+    int len = snprintf(line, sizeof(line), "tank level=%ui,consumption=%di,rate=%di", level, consumption, rate);
+    add_line(line, len, time_stamp);
+}
+
+void telemetry_pump_event(const char *state, int current_mA)
+{
+    char line[TELEMETRY_MAX_LINE];
+    int len = snprintf(line, sizeof(line), "pump,state=%s current=%di", state, current_mA);
+    add_line(line, len, year() >= 2000 ? now() : 0);
+}
+
+void telemetry_handle()
+{
+    if (millis() - last_metrics_ms >= TELEMETRY_METRICS_INTERVAL_MS)
+    {
+        last_metrics_ms = millis();
+        add_metrics();
+    }
+
+    if (!client.connected())
+    {
+        if (connected || connecting)
+        {
+            disconnect("connection lost");
+        }
+        connect();
+        return;
+    }
+#ifdef TELEMETRY_MQTT_TOPIC
+    mqtt_handle();
+#else
+    if (in_flight && client.availableForWrite() >= idle_send_buffer)
+    {
+        confirm();
+    }
+#endif
+    if (!connected)
+    {
+        return;
+    }
+    if (in_flight)
+    {
+        if (millis() - in_flight_ms > TELEMETRY_ACK_TIMEOUT_MS)
+        {
+            disconnect("not acknowledged");
+        }
+        return;
+    }
+
+    if (spill_pending)
+    {
+        send_spill();
+    }
+    else if (queue_len >= TELEMETRY_BATCH_SIZE || (queue_len > 0 && millis() - last_flush_ms >= TELEMETRY_FLUSH_INTERVAL_MS))
+    {
+        send(queue, batch_len(queue, queue_len), false);
+        if (in_flight == queue_len)
+        {
+            last_flush_ms = millis();
+        }
+    }
+}
+
+String telemetry_get_stats_json()
+{
+    return "{\"connected\":" + String(connected ? 1 : 0) + ",\"queued\":" + String(queue_len) +
+           ",\"spill\":" + String(spill_pending ? 1 : 0) + ",\"sent\":" + String(sent_bytes) +
+           ",\"spilled\":" + String(spilled_bytes) + ",\"dropped\":" + String(dropped) +
+           ",\"connects\":" + String(connects) + "}";
+}
+
+#endif
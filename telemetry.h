@@ -0,0 +1,19 @@
+#pragma once
+
+#include <Arduino.h>
+#include "feature_config.h"
+
+// Outbound telemetry in InfluxDB line protocol, see telemetry.cpp
+#ifdef TELEMETRY_SERVER
+void telemetry_init();
+void telemetry_sample(unsigned long time_stamp, uint16_t level, int consumption, int rate);
+void telemetry_pump_event(const char *state, int current_mA);
+void telemetry_handle();
+String telemetry_get_stats_json();
+#else
+inline void telemetry_init() {}
+inline void telemetry_sample(unsigned long time_stamp, uint16_t level, int consumption, int rate) {}
+inline void telemetry_pump_event(const char *state, int current_mA) {}
+inline void telemetry_handle() {}
+inline String telemetry_get_stats_json() { return "null"; }
+#endif
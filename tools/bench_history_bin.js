@@ -0,0 +1,118 @@
+#!/usr/bin/env node
+// Compares payload size and parse time of the JSON history against the
+// binary history format decoded by data/history_bin.js.
+//
+// Both forms are served by the host build of the firmware (see
+// tools/replay/serve.cpp), so the binary comes from history_bin.cpp. The
+// history file is put on its SD card, then /<year>.json and /<year>.bin are
+// fetched and every decoded record is checked against the JSON.
+//
+// Usage: tools/bench_history_bin.js [years] [file.json]
+// Without a file, synthetic daily records are generated. A file holds the
+// comma separated records of a history file copied from the SD card.
+// Build the server with tools/replay/build.sh first.
+'use strict';
+
+const childProcess = require('child_process');
+const fs = require('fs');
+const http = require('http');
+const os = require('os');
+const path = require('path');
+const decodeHistory = require(path.join(__dirname, '..', 'data', 'history_bin.js'));
+
+const SERVE = path.join(__dirname, 'replay', 'serve');
+const PORT = 18090;
+const YEAR = 2020;
+
+function synthetic(years) {
+  const records = [];
+  let ts = 1594512000;
+  let lvl = 600;
+  for (let i = 0; i < years * 365; i++) {
+    ts += 86400 + Math.round(Math.random() * 60 - 30);
+    lvl = Math.max(0, Math.min(1000, lvl + Math.round(Math.random() * 80 - 40)));
+    records.push({ LVL: lvl, TS: ts, CONS: Math.round(Math.random() * 80) });
+  }
+  // Same layout as store_sample() writes on the SD card
+  return records.map((r) => JSON.stringify(r)).join(',\n');
+}
+
+function get(urlPath) {
+  return new Promise((resolve, reject) => {
+    http.get({ port: PORT, path: urlPath }, (res) => {
+      const chunks = [];
+      res.on('data', (chunk) => chunks.push(chunk));
+      res.on('end', () => {
+        if (res.statusCode != 200) {
+          reject(new Error(urlPath + ': HTTP ' + res.statusCode));
+        } else {
+          resolve(Buffer.concat(chunks));
+        }
+      });
+    }).on('error', reject);
+  });
+}
+
+function startServer(sdDir) {
+  return new Promise((resolve, reject) => {
+    const server = childProcess.spawn(SERVE, ['-p', String(PORT), '-s', sdDir], { stdio: ['ignore', 'pipe', 'inherit'] });
+    server.on('error', reject);
+    server.on('exit', (code) => reject(new Error('serve exited with ' + code)));
+    server.stdout.on('data', (data) => {
+      if (data.toString().includes('Serving on port')) {
+        resolve(server);
+      }
+    });
+  });
+}
+
+function time(fn, iterations) {
+  fn();
+  const start = process.hrtime.bigint();
+  for (let i = 0; i < iterations; i++) fn();
+  return Number(process.hrtime.bigint() - start) / 1e6 / iterations;
+}
+
+async function main() {
+  const years = Number(process.argv[2] || 10);
+  const sdDir = fs.mkdtempSync(path.join(os.tmpdir(), 'history-bin-'));
+  const data = process.argv[3] ? fs.readFileSync(process.argv[3], 'utf8') : synthetic(years);
+  fs.writeFileSync(path.join(sdDir, YEAR + '.json'), data);
+
+  const server = await startServer(sdDir);
+  let json, bin;
+  try {
+    json = (await get('/' + YEAR + '.json')).toString();
+    bin = await get('/' + YEAR + '.bin');
+  } finally {
+    server.removeAllListeners('exit');
+    server.kill();
+    fs.rmSync(sdDir, { recursive: true });
+  }
+  const buffer = bin.buffer.slice(bin.byteOffset, bin.byteOffset + bin.byteLength);
+
+  const records = JSON.parse(json);
+  const decoded = decodeHistory(buffer);
+  if (decoded.TS.length != records.length) {
+    throw new Error('Decoded ' + decoded.TS.length + ' records, expected ' + records.length);
+  }
+  records.forEach((r, i) => {
+    if (r.TS != decoded.TS[i] || r.LVL != decoded.LVL[i] || r.CONS != decoded.CONS[i]) {
+      throw new Error('Mismatch at record ' + i);
+    }
+  });
+
+  const iterations = 200;
+  const jsonMs = time(() => JSON.parse(json), iterations);
+  const binMs = time(() => decodeHistory(buffer), iterations);
+  console.log('records      %d', records.length);
+  console.log('json         %d bytes  %s ms', Buffer.byteLength(json), jsonMs.toFixed(3));
+  console.log('binary       %d bytes  %s ms', buffer.byteLength, binMs.toFixed(3));
+  console.log('improvement  %sx smaller  %sx faster',
+    (Buffer.byteLength(json) / buffer.byteLength).toFixed(1), (jsonMs / binMs).toFixed(1));
+}
+
+main().catch((err) => {
+  console.error(err.message);
+  process.exit(1);
+});
@@ -0,0 +1,166 @@
+#!/usr/bin/env python3
+"""Latency and throughput of the web server under concurrent load.
+
+Runs scripted scenarios against the firmware on a bench unit, or against
+the host build (tools/replay/serve), with several clients that each keep
+their own connection alive like a browser does:
+
+  storm    dashboard refresh storm: every client loads the dashboard
+           (/, /stats.json, /24h_history.json, /last30days.json) back to back
+  history  one client downloads the year history (/YYYY.json) over and over
+           while the others poll /stats.json every --poll seconds
+
+The server handles one connection at a time, so clients queue behind each
+other. A request that fails on a connection the server closed while idle
+is sent again on a new one, and counted once with the time of both tries.
+
+Per scenario it prints the requests, errors and p50/p99/max latency per
+path, the throughput, and the longest gap between pump_handle() calls on
+the device during the run (pump_gap_us in /all, which every read resets).
+
+Usage: tools/bench_http.py tank.local [--port 80] [-c 4] [-t 30] [--year 2020] [scenario ...]
+"""
+
+import argparse
+import http.client
+import json
+import math
+import sys
+import threading
+import time
+
+DASHBOARD = ["/", "/stats.json", "/24h_history.json", "/last30days.json"]
+SCENARIOS = ["storm", "history"]
+
+
+class Client:
+    def __init__(self, host, port):
+        self.host = host
+        self.port = port
+        self.conn = None
+        self.results = []  # (path, status, bytes, seconds)
+
+    def fetch(self, path):
+        start = time.monotonic()
+        for attempt in range(2):
+            reused = self.conn is not None
+            if not reused:
+                self.conn = http.client.HTTPConnection(self.host, self.port, timeout=30)
+            try:
+                self.conn.request("GET", path, headers={"Accept-Encoding": "gzip"})
+                response = self.conn.getresponse()
+                body = response.read()
+                if response.getheader("Connection", "").lower() == "close":
+                    self.close()
+                self.results.append((path, response.status, len(body), time.monotonic() - start))
+                return
+            except (OSError, http.client.HTTPException):
+                self.close()
+                if not reused:
+                    break
+        self.results.append((path, 0, 0, time.monotonic() - start))
+
+    def close(self):
+        if self.conn:
+            self.conn.close()
+            self.conn = None
+
+
+def get_json(host, port, path):
+    conn = http.client.HTTPConnection(host, port, timeout=30)
+    conn.request("GET", path)
+    data = json.loads(conn.getresponse().read())
+    conn.close()
+    return data
+
+
+def storm(client, index, args, stop):
+    while not stop.is_set():
+        for path in DASHBOARD:
+            client.fetch(path)
+
+
+def history(client, index, args, stop):
+    if index == 0:
+        while not stop.is_set():
+            client.fetch("/%d.json" % args.year)
+    else:
+        while not stop.wait(args.poll):
+            client.fetch("/stats.json")
+
+
+def percentile(values, p):
+    """Nearest rank, values sorted"""
+    return values[max(0, math.ceil(p / 100.0 * len(values)) - 1)]
+
+
+def run(name, args):
+    get_json(args.host, args.port, "/all")  # Resets the gap
+    clients = [Client(args.host, args.port) for _ in range(args.clients)]
+    stop = threading.Event()
+    worker = globals()[name]
+    threads = [threading.Thread(target=worker, args=(c, i, args, stop)) for i, c in enumerate(clients)]
+    start = time.monotonic()
+    for thread in threads:
+        thread.start()
+    time.sleep(args.time)
+    stop.set()
+    for thread in threads:
+        thread.join()
+    elapsed = time.monotonic() - start
+    for client in clients:
+        client.close()
+    gap_us = get_json(args.host, args.port, "/all").get("pump_gap_us")
+
+    results = [r for c in clients for r in c.results]
+    print("%s: %d clients, %.1f s" % (name, args.clients, elapsed))
+    print("  %-22s %7s %6s %8s %8s %8s" % ("path", "count", "errors", "p50 ms", "p99 ms", "max ms"))
+    errors = 0
+    for path in sorted(set(r[0] for r in results)):
+        times = sorted(r[3] * 1000 for r in results if r[0] == path)
+        failed = sum(1 for r in results if r[0] == path and r[1] not in (200, 304))
+        errors += failed
+        print("  %-22s %7d %6d %8.1f %8.1f %8.1f" % (
+            path, len(times), failed, percentile(times, 50), percentile(times, 99), times[-1]))
+    if results:
+        times = sorted(r[3] * 1000 for r in results)
+        print("  %-22s %7d %6d %8.1f %8.1f %8.1f" % (
+            "all", len(times), errors, percentile(times, 50), percentile(times, 99), times[-1]))
+    kib = sum(r[2] for r in results) / 1024.0
+    print("  throughput %.1f req/s, %.1f KiB/s" % (len(results) / elapsed, kib / elapsed))
+    if gap_us is None:
+        print("  pump_handle gap: not reported by this firmware\n")
+    else:
+        print("  pump_handle gap: max %.1f ms\n" % (gap_us / 1000.0))
+    return errors, gap_us
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("host")
+    parser.add_argument("--port", type=int, default=80)
+    parser.add_argument("-c", "--clients", type=int, default=4)
+    parser.add_argument("-t", "--time", type=float, default=30, help="seconds per scenario")
+    parser.add_argument("--poll", type=float, default=1, help="stats polling interval in the history scenario")
+    parser.add_argument("--year", type=int, help="history file to download, default the year on the device")
+    parser.add_argument("--max-gap-ms", type=float, help="fail if pump_handle stalls for longer")
+    parser.add_argument("scenarios", nargs="*", metavar="scenario", help=" or ".join(SCENARIOS) + ", default both")
+    args = parser.parse_intermixed_args()
+    for name in args.scenarios:
+        if name not in SCENARIOS:
+            parser.error("unknown scenario %s" % name)
+    args.scenarios = args.scenarios or SCENARIOS
+    if args.year is None:
+        args.year = time.gmtime(get_json(args.host, args.port, "/time")["epoch"]).tm_year
+
+    ok = True
+    for name in args.scenarios:
+        errors, gap_us = run(name, args)
+        ok = ok and errors == 0
+        if args.max_gap_ms is not None and gap_us is not None and gap_us > args.max_gap_ms * 1000:
+            ok = False
+    sys.exit(0 if ok else 1)
+
+
+if __name__ == "__main__":
+    main()
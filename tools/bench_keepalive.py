@@ -0,0 +1,55 @@
+#!/usr/bin/env python3
+"""Compare request rate with and without HTTP keep-alive.
+
+Fetches the same paths (a dashboard load by default) repeatedly, first
+opening a new connection per request and then reusing one persistent
+connection, and prints requests per second and time per dashboard load.
+
+Usage: tools/bench_keepalive.py tank.local [-n 20] [paths...]
+"""
+
+import argparse
+import http.client
+import time
+
+DASHBOARD = ["/", "/stats.json", "/24h_history.json"]
+
+
+def fetch(conn, path):
+    conn.request("GET", path, headers={"Accept-Encoding": "gzip"})
+    response = conn.getresponse()
+    response.read()
+    if response.status != 200:
+        raise RuntimeError("%s returned %d" % (path, response.status))
+
+
+def run(host, port, paths, loads, keep_alive):
+    start = time.monotonic()
+    conn = http.client.HTTPConnection(host, port, timeout=10)
+    for _ in range(loads):
+        for path in paths:
+            if not keep_alive:
+                conn.close()
+                conn = http.client.HTTPConnection(host, port, timeout=10)
+            fetch(conn, path)
+    conn.close()
+    return time.monotonic() - start
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("host")
+    parser.add_argument("--port", type=int, default=80)
+    parser.add_argument("-n", "--loads", type=int, default=20, help="number of dashboard loads")
+    parser.add_argument("paths", nargs="*", default=DASHBOARD)
+    args = parser.parse_args()
+
+    requests = args.loads * len(args.paths)
+    for keep_alive in (False, True):
+        elapsed = run(args.host, args.port, args.paths, args.loads, keep_alive)
+        print("%-10s %6.1f req/s  %7.1f ms per load" % (
+            "keep-alive" if keep_alive else "close", requests / elapsed, elapsed * 1000 / args.loads))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,85 @@
+#!/usr/bin/env python3
+"""Soak the web server and track heap fragmentation.
+
+Sends a mix of requests (a dashboard load, a history download, a 404 and
+the ETag revalidation of a page) over a persistent connection, and samples
+/all every --every requests. Prints the free heap, largest free block and
+fragmentation over time, and a summary that compares the start of the run
+with the end. The heap is considered stable when the largest free block at
+the end is within --tolerance percent of the start.
+
+Usage: tools/bench_soak.py tank.local [-n 100000] [--every 1000] [paths...]
+"""
+
+import argparse
+import http.client
+import json
+import sys
+import time
+
+MIX = ["/", "/stats.json", "/24h_history.json", "/time", "/last30days.bin", "/missing.html", "/history.html"]
+
+
+def fetch(conn, path, headers=None):
+    conn.request("GET", path, headers=headers or {})
+    response = conn.getresponse()
+    body = response.read()
+    return response, body
+
+
+def sample(conn):
+    response, body = fetch(conn, "/all")
+    stats = json.loads(body)
+    return stats["heap"], stats["heap_block"], stats["heap_frag"], stats.get("arena_peak", 0)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("host")
+    parser.add_argument("--port", type=int, default=80)
+    parser.add_argument("-n", "--requests", type=int, default=100000)
+    parser.add_argument("--every", type=int, default=1000, help="requests between heap samples")
+    parser.add_argument("--tolerance", type=float, default=10, help="allowed drop of the largest block, percent")
+    parser.add_argument("paths", nargs="*", default=MIX)
+    args = parser.parse_args()
+
+    conn = http.client.HTTPConnection(args.host, args.port, timeout=10)
+    etags = {}
+    errors = 0
+    samples = [sample(conn)]
+    start = time.monotonic()
+    print("%8s %8s %8s %6s %6s %8s" % ("requests", "free", "block", "frag", "arena", "req/s"))
+    for i in range(1, args.requests + 1):
+        path = args.paths[i % len(args.paths)]
+        headers = {"Accept-Encoding": "gzip"}
+        if path in etags:
+            headers["If-None-Match"] = etags[path]
+        try:
+            response, _ = fetch(conn, path, headers)
+            if response.getheader("ETag"):
+                etags[path] = response.getheader("ETag")
+            if response.status >= 500:
+                errors += 1
+        except (OSError, http.client.HTTPException):
+            errors += 1
+            conn.close()
+            conn = http.client.HTTPConnection(args.host, args.port, timeout=10)
+        if i % args.every == 0:
+            samples.append(sample(conn))
+            free, block, frag, arena = samples[-1]
+            print("%8d %8d %8d %5d%% %6d %8.1f" % (i, free, block, frag, arena, i / (time.monotonic() - start)))
+    conn.close()
+
+    first, last = samples[0], samples[-1]
+    min_block = min(s[1] for s in samples)
+    max_frag = max(s[2] for s in samples)
+    drop = 100.0 * (first[1] - last[1]) / first[1]
+    print("free %d -> %d, largest block %d -> %d (min %d), fragmentation %d%% -> %d%% (max %d%%), errors %d" % (
+        first[0], last[0], first[1], last[1], min_block, first[2], last[2], max_frag, errors))
+    stable = drop <= args.tolerance
+    print("heap %s: largest block dropped %.1f%%" % ("stable" if stable else "NOT stable", drop))
+    sys.exit(0 if stable and errors == 0 else 1)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,15 @@
+#!/bin/sh
+# Builds the firmware with arduino-cli. The web UI and the vendored
+# libraries are embedded first with tools/embed_assets.py, which downloads
+# and checks any file missing from vendor/, so /lib/ is served from flash.
+#
+# Usage: tools/build.sh [--fqbn esp8266:esp8266:d1_mini] [arduino-cli compile options ...]
+set -e
+cd "$(dirname "$0")/.."
+FQBN=esp8266:esp8266:d1_mini
+if [ "$1" = "--fqbn" ]; then
+    FQBN=$2
+    shift 2
+fi
+python3 tools/embed_assets.py
+arduino-cli compile --fqbn "$FQBN" "$@" .
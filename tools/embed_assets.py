@@ -0,0 +1,207 @@
+#!/usr/bin/env python3
+"""Embed the web UI into the firmware.
+
+Gzips every file in data/ together with the vendored JavaScript/CSS
+libraries in vendor/ (served as /lib/<name>) and writes assets_data.h with
+one PROGMEM blob per file and a perfect hash table used by assets.cpp.
+
+Run by tools/build.sh before every build. Missing vendor files are
+downloaded once and checked against their subresource integrity hash.
+Commit them so later builds work offline. The same hashes are used by the
+CDN fallback in data/lib_fallback.js and data/*.html, which is checked
+here too, so a build only succeeds with hashes that match the files.
+Without assets_data.h the firmware serves everything from SPIFFS as
+before; copy vendor/ to data/lib/ before uploading the file system then,
+or the pages fall back to the CDNs.
+
+Usage: tools/embed_assets.py [--no-download]
+"""
+
+import argparse
+import base64
+import gzip
+import hashlib
+import os
+import sys
+import urllib.request
+
+ROOT = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+DATA_DIR = os.path.join(ROOT, "data")
+VENDOR_DIR = os.path.join(ROOT, "vendor")
+OUTPUT = os.path.join(ROOT, "assets_data.h")
+
+# Also the CDN fallback in data/, see check_fallback()
+VENDOR = [
+    ("bootstrap-4.5.0.min.css",
+     "https://stackpath.bootstrapcdn.com/bootstrap/4.5.0/css/bootstrap.min.css",
+     "sha384-9aIt2nRpC12Uk9gS9baDl411NQApFmC26EwAOH8WgZl5MYYxFfc+NcPb1dKGj7Sk"),
+    ("bootstrap-4.5.0.min.js",
+     "https://stackpath.bootstrapcdn.com/bootstrap/4.5.0/js/bootstrap.min.js",
+     "sha384-OgVRvuATP1z7JjHLkuOU7Xw704+h835Lr+6QL9UvYjZE3Ipu6Tp75j7Bh/kR0JKI"),
+    ("jquery-3.5.1.min.js",
+     "https://code.jquery.com/jquery-3.5.1.min.js",
+     "sha256-9/aliU8dGd2tb6OSsuzixeV4y/faTqgFtohetphbbj0="),
+    ("popper-1.16.0.min.js",
+     "https://cdn.jsdelivr.net/npm/popper.js@1.16.0/dist/umd/popper.min.js",
+     "sha384-Q6E9RHvbIyZFJoft+2mJbHaEWldlvI9IOYy5n3zV9zzTtmI3UksdQRVvoxMfooAo"),
+    ("moment-2.22.2.min.js",
+     "https://cdnjs.cloudflare.com/ajax/libs/moment.js/2.22.2/moment.min.js",
+     "sha256-CutOzxCRucUsn6C6TcEYsauvvYilEniTXldPa6/wu0k="),
+    ("chart-2.8.0.min.js",
+     "https://cdnjs.cloudflare.com/ajax/libs/Chart.js/2.8.0/Chart.min.js",
+     "sha256-Uv9BNBucvCPipKQ2NS9wYpJmi8DTOEfTA/nH2aoJALw="),
+]
+
+MIME_TYPES = {
+    ".html": "text/html",
+    ".css": "text/css",
+    ".js": "application/javascript",
+    ".json": "text/json",
+    ".ico": "image/x-icon",
+    ".png": "image/png",
+    ".svg": "image/svg+xml",
+}
+
+FNV_OFFSET = 2166136261
+FNV_PRIME = 16777619
+
+
+def fnv1a(path, seed):
+    # Must match assets_hash() in assets.h
+    h = FNV_OFFSET ^ seed
+    for c in path.encode():
+        h = ((h ^ c) * FNV_PRIME) & 0xFFFFFFFF
+    return h
+
+
+def check_integrity(content, integrity):
+    algo, expected = integrity.split("-", 1)
+    digest = base64.b64encode(hashlib.new(algo, content).digest()).decode()
+    return digest == expected
+
+
+def check_fallback():
+    """Every CDN URL in data/ must come with the integrity hash of VENDOR"""
+    sources = {}
+    for name in os.listdir(DATA_DIR):
+        if name.endswith((".html", ".js")):
+            with open(os.path.join(DATA_DIR, name)) as f:
+                sources[name] = f.read()
+    for name, url, integrity in VENDOR:
+        for source, text in sources.items():
+            if url in text and integrity not in text:
+                sys.exit("%s loads %s without integrity %s" % (source, url, integrity))
+
+
+def fetch_vendor(download):
+    os.makedirs(VENDOR_DIR, exist_ok=True)
+    for name, url, integrity in VENDOR:
+        path = os.path.join(VENDOR_DIR, name)
+        if os.path.exists(path):
+            continue
+        if not download:
+            sys.exit("Missing vendor file %s (run without --no-download)" % name)
+        print("Downloading %s" % url)
+        try:
+            content = urllib.request.urlopen(url).read()
+        except OSError as e:
+            sys.exit("Download of %s failed: %s" % (url, e))
+        if not check_integrity(content, integrity):
+            sys.exit("Integrity check failed for %s" % url)
+        with open(path, "wb") as f:
+            f.write(content)
+
+
+def collect_assets():
+    assets = []
+    for name in sorted(os.listdir(DATA_DIR)):
+        assets.append(("/" + name, os.path.join(DATA_DIR, name)))
+    for name, _, _ in VENDOR:
+        assets.append(("/lib/" + name, os.path.join(VENDOR_DIR, name)))
+    return assets
+
+
+def slot_of(path, seed, bits):
+    # The low bits of FNV-1a only depend on the low bits of the input, so
+    # the slot is taken from the top bits where the seed has an effect
+    return fnv1a(path, seed) >> (32 - bits)
+
+
+def find_perfect_hash(paths):
+    bits = 1
+    while (1 << bits) < len(paths) * 2:
+        bits += 1
+    while True:
+        for seed in range(1, 100000):
+            slots = set(slot_of(p, seed, bits) for p in paths)
+            if len(slots) == len(paths):
+                return seed, bits
+        bits += 1
+
+
+def c_bytes(data):
+    lines = []
+    for i in range(0, len(data), 20):
+        lines.append("    " + ", ".join("0x%02x" % b for b in data[i:i + 20]) + ",")
+    return "\n".join(lines)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--no-download", action="store_true", help="fail instead of downloading vendor files")
+    args = parser.parse_args()
+
+    check_fallback()
+    fetch_vendor(not args.no_download)
+    assets = collect_assets()
+    seed, bits = find_perfect_hash([path for path, _ in assets])
+    size = 1 << bits
+
+    out = ["// Generated by tools/embed_assets.py, do not edit", "#pragma once", ""]
+    table = ["{NULL, NULL, NULL, NULL, 0}"] * size
+    checks = []
+    total = 0
+    for i, (path, filename) in enumerate(assets):
+        with open(filename, "rb") as f:
+            content = f.read()
+        blob = gzip.compress(content, compresslevel=9, mtime=0)
+        etag = '"%s"' % hashlib.sha1(blob).hexdigest()[:16]
+        mime = MIME_TYPES.get(os.path.splitext(path)[1], "text/plain")
+        slot = slot_of(path, seed, bits)
+        total += len(blob)
+        print("%-32s %7d -> %6d bytes" % (path, len(content), len(blob)))
+
+        out.append('static const char asset_%d_path[] PROGMEM = "%s";' % (i, path))
+        out.append('static const char asset_%d_type[] PROGMEM = "%s";' % (i, mime))
+        out.append('static const char asset_%d_etag[] PROGMEM = "%s";' % (i, etag.replace('"', '\\"')))
+        out.append("static const uint8_t asset_%d_data[] PROGMEM = {" % i)
+        out.append(c_bytes(blob))
+        out.append("};")
+        out.append("")
+        table[slot] = "{asset_%d_path, asset_%d_type, asset_%d_etag, asset_%d_data, sizeof(asset_%d_data)}" % (
+            i, i, i, i, i)
+        checks.append('static_assert(assets_slot("%s") == %d, "Asset hash mismatch");' % (path, slot))
+
+    out.append("#define ASSET_HASH_SEED %du" % seed)
+    out.append("#define ASSET_TABLE_BITS %d" % bits)
+    out.append("#define ASSET_TABLE_SIZE (1 << ASSET_TABLE_BITS)")
+    out.append("")
+    out.append("static const asset_t asset_table[ASSET_TABLE_SIZE] = {")
+    out.extend("    %s," % entry for entry in table)
+    out.append("};")
+    out.append("")
+    out.append("constexpr uint32_t assets_slot(const char *path)")
+    out.append("{")
+    out.append("    return assets_hash(path, FNV_OFFSET_BASIS ^ ASSET_HASH_SEED) >> (32 - ASSET_TABLE_BITS);")
+    out.append("}")
+    out.append("")
+    out.extend(checks)
+    out.append("")
+
+    with open(OUTPUT, "w") as f:
+        f.write("\n".join(out))
+    print("%d assets, %d bytes compressed, table size %d, seed %d" % (len(assets), total, size, seed))
+
+
+if __name__ == "__main__":
+    main()
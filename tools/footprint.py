@@ -0,0 +1,138 @@
+#!/usr/bin/env python3
+"""Per-module flash and RAM footprint of the firmware.
+
+Builds the sketch for each feature profile (see feature_config.h) with
+arduino-cli, after embedding the web UI like tools/build.sh, or reads an existing linker map, and sums the ESP8266 output
+sections per module: sketch source files one by one, Arduino libraries by
+name and other archives (core, SDK, toolchain) by file name.
+
+  FLASH  everything stored in flash (.irom0.text, .text, .data, .rodata)
+  IRAM   code in instruction RAM (.text)
+  DRAM   initialized data in RAM (.data, .rodata)
+  BSS    zeroed data in RAM (.bss)
+
+Usage: tools/footprint.py [--fqbn esp8266:esp8266:d1_mini] [--profile full no_sd ...]
+       tools/footprint.py --map build/tank_level.ino.map
+"""
+
+import argparse
+import collections
+import os
+import re
+import subprocess
+import sys
+
+PROFILES = {"full": 0, "no_sd": 1, "pump_only": 2}
+SKETCH_DIR = os.path.normpath(os.path.join(os.path.dirname(os.path.abspath(__file__)), ".."))
+BUILD_DIR = os.path.join(SKETCH_DIR, "_footprint")
+
+FLASH = (".irom0.text", ".text", ".data", ".rodata")
+COLUMNS = {"FLASH": FLASH, "IRAM": (".text",), "DRAM": (".data", ".rodata"), "BSS": (".bss",)}
+
+OUTPUT_SECTION = re.compile(r"^(\.[\w.]+)(?:\s+0x[0-9a-f]+\s+0x[0-9a-f]+)?\s*$")
+INPUT_SECTION = re.compile(r"^ (\S+)(?:\s+0x([0-9a-f]+)\s+0x([0-9a-f]+)\s+(\S.*))?$")
+CONTINUATION = re.compile(r"^\s+0x([0-9a-f]+)\s+0x([0-9a-f]+)\s+(\S.*)$")
+
+
+def module_name(path):
+    archive = re.match(r"(.*)\((.*)\)$", path)
+    if archive:
+        return os.path.basename(archive.group(1))
+    parts = path.replace("\\", "/").split("/")
+    if "libraries" in parts:
+        return "lib " + parts[parts.index("libraries") + 1]
+    if "sketch" in parts:
+        return parts[-1][:-2] if parts[-1].endswith(".o") else parts[-1]
+    return os.path.basename(path)
+
+
+def parse_map(path):
+    """Returns {module: {output section: bytes}}"""
+    sizes = collections.defaultdict(collections.Counter)
+    output = None
+    pending = None
+    in_memory_map = False
+    with open(path, errors="replace") as f:
+        for line in f:
+            line = line.rstrip("\n")
+            if line.startswith("Linker script and memory map"):
+                in_memory_map = True
+                continue
+            if not in_memory_map:
+                continue
+            match = OUTPUT_SECTION.match(line)
+            if match:
+                output = match.group(1)
+                pending = None
+                continue
+            if output not in FLASH + (".bss",):
+                continue
+            match = INPUT_SECTION.match(line)
+            if match and not match.group(1).startswith("*"):
+                if match.group(2) is None:
+                    pending = match.group(1)  # Long name, address and size follow on the next line
+                else:
+                    sizes[module_name(match.group(4))][output] += int(match.group(3), 16)
+                continue
+            match = CONTINUATION.match(line)
+            if match and pending:
+                sizes[module_name(match.group(3))][output] += int(match.group(2), 16)
+            pending = None
+    return sizes
+
+
+def totals(sizes):
+    result = {}
+    for module, sections in sizes.items():
+        result[module] = {name: sum(sections[s] for s in parts) for name, parts in COLUMNS.items()}
+    return result
+
+
+def print_table(title, sizes, limit):
+    rows = sorted(totals(sizes).items(), key=lambda item: -(item[1]["FLASH"] + item[1]["BSS"]))
+    print(title)
+    print("%-28s %8s %8s %8s %8s" % ("module", *COLUMNS))
+    for module, row in rows[:limit]:
+        print("%-28s %8d %8d %8d %8d" % (module[:28], *(row[c] for c in COLUMNS)))
+    rest = rows[limit:]
+    if rest:
+        print("%-28s %8d %8d %8d %8d" % ("(%d more)" % len(rest), *(sum(r[c] for _, r in rest) for c in COLUMNS)))
+    print("%-28s %8d %8d %8d %8d\n" % ("total", *(sum(r[c] for _, r in rows) for c in COLUMNS)))
+
+
+def build(fqbn, profile):
+    build_path = os.path.join(BUILD_DIR, profile)
+    command = ["arduino-cli", "compile", "--fqbn", fqbn, "--build-path", build_path,
+               "--build-property", "compiler.cpp.extra_flags=-DFEATURE_PROFILE=%d" % PROFILES[profile], SKETCH_DIR]
+    result = subprocess.run(command, stdout=subprocess.PIPE, stderr=subprocess.STDOUT, universal_newlines=True)
+    if result.returncode != 0:
+        sys.exit("Build of %s failed:\n%s" % (profile, result.stdout))
+    return os.path.join(build_path, os.path.basename(SKETCH_DIR) + ".ino.map")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--fqbn", default="esp8266:esp8266:d1_mini")
+    parser.add_argument("--profile", nargs="+", choices=PROFILES, default=list(PROFILES))
+    parser.add_argument("--map", help="report an existing linker map instead of building")
+    parser.add_argument("--top", type=int, default=25, help="modules listed per profile")
+    args = parser.parse_args()
+
+    if args.map:
+        print_table(args.map, parse_map(args.map), args.top)
+        return
+
+    subprocess.run([sys.executable, os.path.join(SKETCH_DIR, "tools", "embed_assets.py")], check=True)
+    summary = []
+    for profile in args.profile:
+        sizes = parse_map(build(args.fqbn, profile))
+        print_table("Profile %s" % profile, sizes, args.top)
+        rows = totals(sizes).values()
+        summary.append((profile, {c: sum(r[c] for r in rows) for c in COLUMNS}))
+    print("%-28s %8s %8s %8s %8s" % ("profile", *COLUMNS))
+    for profile, row in summary:
+        print("%-28s %8d %8d %8d %8d" % (profile, *(row[c] for c in COLUMNS)))
+
+
+if __name__ == "__main__":
+    main()
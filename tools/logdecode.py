@@ -0,0 +1,123 @@
+#!/usr/bin/env python3
+"""Decode the binary log ring written with LOG_USE_BINARY.
+
+Reads the /logN.bin segment files copied from the SD card and prints the
+records oldest first. Format strings are looked up by address in the ELF
+file of the firmware that wrote them (see log_ring.cpp for the format).
+
+Usage: tools/logdecode.py --elf tank_level.ino.elf log0.bin log1.bin ...
+"""
+
+import argparse
+import re
+import struct
+import sys
+
+PRIORITIES = {11: "Error", 12: "Warning", 14: "Info"}
+MAX_STRING = 48
+SPEC = re.compile(r"%([-+ #0-9.]*)([hlLqjzt]*)([a-zA-Z%])")
+
+
+class Elf:
+    """Just enough of ELF32 to read C strings by address."""
+
+    def __init__(self, path):
+        with open(path, "rb") as f:
+            self.data = f.read()
+        if self.data[:4] != b"\x7fELF" or self.data[4] != 1:
+            sys.exit("%s: not an ELF32 file" % path)
+        shoff, = struct.unpack_from("<I", self.data, 0x20)
+        shentsize, shnum = struct.unpack_from("<HH", self.data, 0x2E)
+        self.sections = []
+        for i in range(shnum):
+            _, sh_type, _, addr, offset, size = struct.unpack_from("<IIIIII", self.data, shoff + i * shentsize)
+            if sh_type == 1 and addr:  # SHT_PROGBITS, loaded
+                self.sections.append((addr, offset, size))
+
+    def string(self, addr):
+        for start, offset, size in self.sections:
+            if start <= addr < start + size:
+                pos = offset + addr - start
+                end = self.data.index(b"\0", pos)
+                return self.data[pos:end].decode(errors="replace")
+        return None
+
+
+def format_record(fmt, args):
+    out = []
+    pos = 0
+    last = 0
+    for m in SPEC.finditer(fmt):
+        out.append(fmt[last:m.start()])
+        last = m.end()
+        flags, length, conv = m.groups()
+        if conv == "%":
+            out.append("%")
+            continue
+        if conv == "s":
+            n = args[pos]
+            value = args[pos + 1:pos + 1 + n].decode(errors="replace")
+            pos += 1 + n
+        elif conv in "fFeEgG":
+            value, = struct.unpack_from("<d", args, pos)
+            pos += 8
+        elif length.count("l") + length.count("q") + length.count("L") >= 2:
+            value, = struct.unpack_from("<q" if conv in "di" else "<Q", args, pos)
+            pos += 8
+        else:
+            value, = struct.unpack_from("<i" if conv in "di" else "<I", args, pos)
+            pos += 4
+        if conv in "uip":
+            conv = "x" if conv == "p" else "d"
+        if conv == "c":
+            value = chr(value & 0xFF)
+        out.append(("%" + flags + conv) % value)
+    out.append(fmt[last:])
+    return "".join(out)
+
+
+def read_segment(path):
+    with open(path, "rb") as f:
+        data = f.read()
+    if len(data) < 12 or data[:4] != b"TLL1":
+        return None
+    build_id, seq = struct.unpack_from("<II", data, 4)
+    records = []
+    pos = 12
+    while pos < len(data):
+        length = data[pos]
+        if length < 13 or pos + 1 + length > len(data):
+            break
+        records.append(data[pos + 1:pos + 1 + length])
+        pos += 1 + length
+    return seq, build_id, records
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--elf", required=True, help="firmware ELF file matching the log")
+    parser.add_argument("segments", nargs="+")
+    args = parser.parse_args()
+
+    elf = Elf(args.elf)
+    segments = [s for s in (read_segment(p) for p in args.segments) if s]
+    builds = set()
+    for seq, build_id, records in sorted(segments):
+        builds.add(build_id)
+        for record in records:
+            epoch, millis, pri, fmt_addr = struct.unpack_from("<IIBI", record, 0)
+            fmt = elf.string(fmt_addr)
+            if fmt is None:
+                text = "[fmt 0x%08x not in ELF]" % fmt_addr
+            else:
+                try:
+                    text = format_record(fmt, record[13:])
+                except (struct.error, IndexError, TypeError, ValueError):
+                    text = "[bad arguments for %r]" % fmt
+            print("%u %u.%03u <%s> %s" % (epoch, millis // 1000, millis % 1000, PRIORITIES.get(pri, pri), text))
+    if len(builds) > 1:
+        print("Warning: log written by %d different builds" % len(builds), file=sys.stderr)
+
+
+if __name__ == "__main__":
+    main()
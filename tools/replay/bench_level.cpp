@@ -0,0 +1,175 @@
+// Compares the level estimator with the previous filter chain (median of
+// five echoes into an 8 entry mean filter) on a recorded or synthetic trace.
+//
+// With a truth file from synth_trace.py --truth, reports error against the
+// real level: samples until the estimate is first within CONVERGED_ERROR,
+// samples off by more than that, lag while the level is moving and noise
+// while it is steady. Without one, only the minute to minute
+// jitter of each estimate is reported.
+//
+// Usage: bench_level trace.bin [truth.csv]
+#include <Arduino.h>
+#include <MeanFilterLib.h>
+
+#include <chrono>
+#include <cmath>
+#include <vector>
+
+#include "../../level_estimator.h"
+#include "trace_file.h"
+
+#define BURST_GAP_MS 1000
+#define MOVING_RATE 20     // Per mille/h, above this the level is moving
+#define STEADY_RATE 2      // Per mille/h, below this it is steady
+#define CONVERGED_ERROR 5  // Per mille
+
+// Same conversion as tank_get_level()
+static double duration_to_level(long duration)
+{
+    long distance_mm = (duration * 34) / 200 - 40;
+    if (distance_mm < 0)
+        distance_mm = 0;
+    if (distance_mm > 920)
+        distance_mm = 920;
+    return (920 - distance_mm) * 1000.0 / 920;
+}
+
+struct Burst
+{
+    unsigned long t;
+    long median;
+    long spread;
+    bool valid;
+};
+
+struct Stats
+{
+    const char *name;
+    std::vector<double> levels;
+    double ns_per_update;
+};
+
+static void report(Stats &stats, const std::vector<Burst> &bursts, const std::vector<double> &truth)
+{
+    double jitter = 0;
+    for (size_t i = 1; i < stats.levels.size(); i++)
+        jitter += pow(stats.levels[i] - stats.levels[i - 1], 2);
+    jitter = sqrt(jitter / (stats.levels.size() - 1));
+
+    if (truth.empty())
+    {
+        printf("%-11s jitter %6.2f  %6.1f ns/update\n", stats.name, jitter, stats.ns_per_update);
+        return;
+    }
+
+    int converged = -1;
+    double lag_err = 0, lag_rate = 0, noise = 0, rms = 0;
+    int noise_n = 0, off = 0;
+    for (size_t i = 0; i < stats.levels.size(); i++)
+    {
+        double err = stats.levels[i] - truth[i];
+        rms += err * err;
+        if (converged < 0 && fabs(err) <= CONVERGED_ERROR)
+            converged = i;
+        if (fabs(err) > CONVERGED_ERROR)
+            off++;
+        if (i == 0 || i + 1 == truth.size())
+            continue;
+        double rate = (truth[i + 1] - truth[i - 1]) / (bursts[i + 1].t - bursts[i - 1].t) * 3600000.0;
+        if (fabs(rate) > MOVING_RATE)
+        {
+            // Trailing error divided by rate is the lag
+            lag_err += -err * (rate > 0 ? 1 : -1);
+            lag_rate += fabs(rate);
+        }
+        else if (fabs(rate) < STEADY_RATE)
+        {
+            noise += err * err;
+            noise_n++;
+        }
+    }
+    printf("%-11s converged %3d  off %4d  lag %5.1f min  noise %5.2f  rms %6.2f  jitter %5.2f  %6.1f ns/update\n",
+           stats.name, converged, off, lag_rate ? lag_err / lag_rate * 60 : 0, noise_n ? sqrt(noise / noise_n) : 0,
+           sqrt(rms / stats.levels.size()), jitter, stats.ns_per_update);
+}
+
+template <typename F>
+static double time_ns(size_t n, F fn)
+{
+    auto start = std::chrono::steady_clock::now();
+    fn();
+    return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / n;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "Usage: %s trace.bin [truth.csv]\n", argv[0]);
+        return 1;
+    }
+    std::vector<TraceRecord> records;
+    if (!trace_file_load(argv[1], records))
+        return 1;
+
+    std::vector<Burst> bursts;
+    for (size_t i = 0; i < records.size(); i++)
+    {
+        if (records[i].type != TraceEcho)
+            continue;
+        Burst burst = {records[i].t, 0, 0, true};
+        std::vector<long> values;
+        for (; i < records.size() && records[i].t - burst.t < BURST_GAP_MS; i++)
+        {
+            if (records[i].type != TraceEcho)
+                continue;
+            values.push_back(records[i].value);
+            burst.valid &= records[i].value != 0;
+        }
+        i--;
+        level_burst_stats(values.data(), values.size(), burst.median, burst.spread);
+        bursts.push_back(burst);
+    }
+
+    std::vector<double> truth;
+    if (argc > 2)
+    {
+        FILE *file = fopen(argv[2], "r");
+        unsigned long t;
+        double level;
+        while (file && fscanf(file, "%lu,%lf", &t, &level) == 2)
+            truth.push_back(level);
+        if (file)
+            fclose(file);
+        truth.resize(bursts.size(), truth.empty() ? 0 : truth.back());
+    }
+
+    Stats mean = {"median+mean", {}, 0};
+    std::vector<long> mean_out(bursts.size());
+    MeanFilter<long> mean_filter(8);
+    mean.ns_per_update = time_ns(bursts.size(), [&]() {
+        for (size_t i = 0; i < bursts.size(); i++)
+            mean_out[i] = mean_filter.AddValue(bursts[i].median);
+    });
+    for (long duration : mean_out)
+        mean.levels.push_back(duration_to_level(duration));
+
+    Stats kalman = {"estimator", {}, 0};
+    std::vector<long> kalman_out(bursts.size());
+    LevelEstimator estimator;
+    kalman.ns_per_update = time_ns(bursts.size(), [&]() {
+        for (size_t i = 0; i < bursts.size(); i++)
+        {
+            if (bursts[i].valid)
+                estimator.add(bursts[i].median, bursts[i].spread, bursts[i].t);
+            kalman_out[i] = estimator.get();
+        }
+    });
+    for (long duration : kalman_out)
+        kalman.levels.push_back(duration_to_level(duration));
+
+    printf("%zu bursts\n", bursts.size());
+    report(mean, bursts, truth);
+    report(kalman, bursts, truth);
+    return 0;
+}
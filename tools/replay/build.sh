@@ -0,0 +1,12 @@
+#!/bin/sh
+# Builds the host replay tool and web server from the sketch sources and
+# the stubs, and the level estimator benchmark
+set -e
+cd "$(dirname "$0")"
+SKETCH=../..
+${CXX:-g++} -std=c++11 -O2 -Wall -Wno-unused-variable -Istubs -I$SKETCH \
+    replay.cpp sim.cpp $SKETCH/tank.cpp $SKETCH/pump.cpp $SKETCH/Log.cpp -o replay
+${CXX:-g++} -std=c++11 -O2 -Wall -Istubs bench_level.cpp -o bench_level
+${CXX:-g++} -std=c++11 -O2 -Wall -Wno-unused-variable -Istubs -I$SKETCH \
+    serve.cpp sim.cpp $SKETCH/tank.cpp $SKETCH/pump.cpp $SKETCH/Log.cpp $SKETCH/server.cpp \
+    $SKETCH/assets.cpp $SKETCH/history_bin.cpp -o serve
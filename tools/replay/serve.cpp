@@ -0,0 +1,133 @@
+// Runs the web server with the real tank and pump logic on the host, so
+// the routes can be benchmarked without a device (see tools/bench_http.py).
+//
+// The trace is first replayed in virtual time, as replay does, to fill the
+// in-RAM history and the history files on the in-memory SD card. Then the
+// loop runs in real time with the last readings held, calling the handlers
+// in the order loop() in the sketch does, so /all reports how long requests
+// stall pump_handle() here just like on the device. Absolute times are of
+// course much shorter than on an ESP8266.
+//
+// Usage: serve [-v] [-p port] [-d data_dir] [-s sd_dir] [trace.bin]
+//   -d  directory served as SPIFFS, default data
+//   -s  directory whose files are copied to the SD card before the replay,
+//       e.g. history files for tools/bench_history_bin.js
+#include <Arduino.h>
+#include <ESP8266WebServer.h>
+#include <SD.h>
+#include <TimeLib.h>
+
+#include <chrono>
+#include <dirent.h>
+#include <unistd.h>
+
+#include "sim.h"
+#include "tank.h"
+#include "pump.h"
+#include "server.h"
+#include "wifi_connect.h"
+
+#define STEP_MS 101  // Replay step, as in replay.cpp
+#define IDLE_US 100 // Sleep per loop, so an idle server does not spin a core
+
+FSStub SPIFFS;
+uint16_t stub_server_port = 8080;
+
+#if FEATURE_WIFI
+// There is no station to report on
+String wifi_get_stats_json() { return "null"; }
+#endif
+
+static bool load_sd_dir(const char *dir)
+{
+    DIR *d = opendir(dir);
+    if (!d)
+    {
+        perror(dir);
+        return false;
+    }
+    struct dirent *entry;
+    while ((entry = readdir(d)) != NULL)
+    {
+        if (entry->d_name[0] == '.')
+            continue;
+        FSStub host;
+        host.root = dir;
+        String path = String("/") + entry->d_name;
+        File src = host.open(path.c_str(), "r");
+        if (!src)
+            continue;
+        File dst = SD.open(path, FILE_WRITE);
+        uint8_t buf[4096];
+        int n;
+        while ((n = src.read(buf, sizeof(buf))) > 0)
+            dst.write(buf, n);
+    }
+    closedir(d);
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    int opt;
+    while ((opt = getopt(argc, argv, "vp:d:s:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'v':
+            Serial.enabled = true;
+            break;
+        case 'p':
+            stub_server_port = strtoul(optarg, NULL, 10);
+            break;
+        case 'd':
+            SPIFFS.root = optarg;
+            break;
+        case 's':
+            if (!load_sd_dir(optarg))
+                return 1;
+            break;
+        default:
+            fprintf(stderr, "Usage: %s [-v] [-p port] [-d data_dir] [-s sd_dir] [trace.bin]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    tank_init();
+    pump_init();
+    if (optind < argc)
+    {
+        if (!sim_load_trace(argv[optind]))
+            return 1;
+        unsigned long end_ms = sim_trace_end_ms();
+        for (; millis() <= end_ms; sim_us += STEP_MS * 1000)
+        {
+            sim_set_time();
+            tank_handle();
+            pump_handle();
+        }
+        printf("Replayed %lu s of the trace\n", end_ms / 1000);
+    }
+    else
+    {
+        setTime(time(NULL));
+    }
+    pump_get_max_gap_us(); // Only count gaps from here on
+
+    server_init();
+    printf("Serving on port %u\n", stub_server_port);
+    fflush(stdout);
+
+    unsigned long long base_us = sim_us;
+    auto start = std::chrono::steady_clock::now();
+    for (;;)
+    {
+        sim_us = base_us + std::chrono::duration_cast<std::chrono::microseconds>(
+                               std::chrono::steady_clock::now() - start).count();
+        sim_set_time();
+        tank_handle();
+        server_handle();
+        pump_handle();
+        usleep(IDLE_US);
+    }
+}
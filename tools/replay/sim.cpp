@@ -0,0 +1,151 @@
+// Echo durations are handed to pulseIn() in recorded order, ADC readings
+// are held until the next one and TraceTime records set the clock. After
+// the end of the trace the last readings are held.
+#include <Arduino.h>
+#include <SD.h>
+#include <TimeLib.h>
+
+#include <vector>
+
+#include "sim.h"
+#include "tank.h"
+#include "telemetry.h"
+#include "trace.h"
+#include "trace_file.h"
+
+#define ECHO_LOOKAHEAD_MS 1000 // A burst is recorded over a few ms after the step that triggers it
+
+struct Record
+{
+    unsigned long t;
+    long value;
+};
+
+struct Stream
+{
+    std::vector<Record> records;
+    size_t next = 0;
+    long value = 0;
+};
+
+HardwareSerial Serial;
+SDClass SD;
+EspClass ESP;
+
+unsigned long long sim_us;
+
+static time_t time_base;
+static unsigned long time_base_ms;
+static time_t cached_time = -1;
+static struct tm cached_tm;
+
+static Stream echoes;
+static Stream currents;
+static Stream times;
+
+#ifdef TRACE_RECORD
+// The sketch settings enable recording, there is nothing to record here
+void trace_init() {}
+void trace_record(TraceType type, long value) {}
+void trace_handle() {}
+#endif
+
+#ifdef TELEMETRY_SERVER
+// Nor anywhere to send telemetry to
+void telemetry_init() {}
+void telemetry_sample(unsigned long time_stamp, uint16_t level, int consumption, int rate) {}
+void telemetry_pump_event(const char *state, int current_mA) {}
+void telemetry_handle() {}
+String telemetry_get_stats_json() { return "null"; }
+#endif
+
+unsigned long millis() { return sim_us / 1000; }
+unsigned long micros() { return sim_us; }
+void delay(unsigned long ms) { sim_us += ms * 1000; }
+void delayMicroseconds(unsigned int us) {}
+void pinMode(uint8_t pin, uint8_t mode) {}
+void digitalWrite(uint8_t pin, uint8_t value) {}
+int digitalRead(uint8_t pin) { return HIGH; } // Button not pushed
+
+int analogRead(uint8_t pin)
+{
+    while (currents.next < currents.records.size() && currents.records[currents.next].t <= millis())
+    {
+        currents.value = currents.records[currents.next++].value;
+    }
+    return currents.value;
+}
+
+unsigned long pulseIn(uint8_t pin, uint8_t state, unsigned long timeout)
+{
+    if (echoes.next < echoes.records.size() && echoes.records[echoes.next].t <= millis() + ECHO_LOOKAHEAD_MS)
+    {
+        echoes.value = echoes.records[echoes.next++].value;
+    }
+    return echoes.value;
+}
+
+time_t now() { return time_base + (millis() - time_base_ms) / 1000; }
+
+void setTime(time_t t)
+{
+    time_base = t;
+    time_base_ms = millis();
+}
+
+static struct tm *now_tm()
+{
+    time_t t = now();
+    if (t != cached_time)
+    {
+        cached_time = t;
+        gmtime_r(&t, &cached_tm);
+    }
+    return &cached_tm;
+}
+
+int year() { return now_tm()->tm_year + 1900; }
+int month() { return now_tm()->tm_mon + 1; }
+int day() { return now_tm()->tm_mday; }
+int hour() { return now_tm()->tm_hour; }
+int minute() { return now_tm()->tm_min; }
+int second() { return now_tm()->tm_sec; }
+
+bool sim_load_trace(const char *path)
+{
+    std::vector<TraceRecord> records;
+    if (!trace_file_load(path, records))
+    {
+        return false;
+    }
+    Stream *streams[] = {&times, &echoes, &currents};
+    for (const TraceRecord &record : records)
+    {
+        streams[record.type]->records.push_back({record.t, record.value});
+    }
+    return true;
+}
+
+size_t sim_trace_count(TraceType type)
+{
+    return (type == TraceEcho ? echoes : type == TraceCurrent ? currents : times).records.size();
+}
+
+unsigned long sim_trace_end_ms()
+{
+    unsigned long end_ms = 0;
+    for (Stream *stream : {&times, &echoes, &currents})
+    {
+        if (!stream->records.empty() && stream->records.back().t > end_ms)
+            end_ms = stream->records.back().t;
+    }
+    return end_ms;
+}
+
+void sim_set_time()
+{
+    while (times.next < times.records.size() && times.records[times.next].t <= millis())
+    {
+        setTime(times.records[times.next++].value);
+    }
+}
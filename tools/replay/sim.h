@@ -0,0 +1,19 @@
+// Host implementation of the Arduino, TimeLib and SD stubs, fed from a
+// recorded sensor trace. Shared by replay.cpp and serve.cpp.
+#pragma once
+
+#include <stddef.h>
+
+#include "../../trace.h"
+
+// Virtual time since boot, returned by millis() and micros()
+extern unsigned long long sim_us;
+
+// Loads a trace recorded with TRACE_RECORD (see trace.cpp)
+bool sim_load_trace(const char *path);
+size_t sim_trace_count(TraceType type);
+// Time of the last record in the trace
+unsigned long sim_trace_end_ms();
+// Sets the clock from the time records up to the current virtual time, as
+// NTP does on the device
+void sim_set_time();
@@ -0,0 +1,119 @@
+// Minimal Arduino API for building the sketch logic on a host, see replay.cpp
+#pragma once
+
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+
+typedef uint16_t uint16;
+typedef bool boolean;
+
+#define HIGH 1
+#define LOW 0
+#define INPUT 0
+#define OUTPUT 1
+#define A0 17
+
+#define PROGMEM
+typedef const char *PGM_P;
+#define strlen_P strlen
+#define strcpy_P strcpy
+#define strcmp_P strcmp
+
+// GPIO input and output registers
+#define GPI 0u
+#define GPO 0u
+#define GP16I 0u
+
+// Provided by the replay engine
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+int digitalRead(uint8_t pin);
+int analogRead(uint8_t pin);
+unsigned long pulseIn(uint8_t pin, uint8_t state, unsigned long timeout = 1000000L);
+
+class String
+{
+    std::string str;
+
+public:
+    String() {}
+    String(const char *s) : str(s ? s : "") {}
+    String(const std::string &s) : str(s) {}
+    String(char c) : str(1, c) {}
+    String(int value) : str(std::to_string(value)) {}
+    String(unsigned int value) : str(std::to_string(value)) {}
+    String(long value) : str(std::to_string(value)) {}
+    String(unsigned long value) : str(std::to_string(value)) {}
+    String(long long value) : str(std::to_string(value)) {}
+    String(unsigned long long value) : str(std::to_string(value)) {}
+
+    const char *c_str() const { return str.c_str(); }
+    unsigned int length() const { return str.length(); }
+    bool endsWith(const String &suffix) const
+    {
+        return str.size() >= suffix.str.size() && str.compare(str.size() - suffix.str.size(), std::string::npos, suffix.str) == 0;
+    }
+    String substring(unsigned int from, unsigned int to = -1) const
+    {
+        from = from < str.size() ? from : str.size();
+        return String(str.substr(from, to < from ? 0 : to - from));
+    }
+    bool startsWith(const String &prefix) const { return str.compare(0, prefix.str.size(), prefix.str) == 0; }
+    bool operator==(const String &other) const { return str == other.str; }
+    bool operator!=(const String &other) const { return str != other.str; }
+    String &operator+=(const String &other)
+    {
+        str += other.str;
+        return *this;
+    }
+    friend String operator+(const String &a, const String &b) { return String(a.str + b.str); }
+    friend String operator+(const char *a, const String &b) { return String(a + b.str); }
+    friend String operator+(const String &a, const char *b) { return String(a.str + b); }
+};
+
+class HardwareSerial
+{
+public:
+    bool enabled = false;
+    void begin(unsigned long baud) {}
+    void print(const char *s)
+    {
+        if (enabled)
+            fputs(s, stderr);
+    }
+    void println(const char *s)
+    {
+        if (enabled)
+            fprintf(stderr, "%s\n", s);
+    }
+    void printf(const char *fmt, ...)
+    {
+        if (!enabled)
+            return;
+        va_list args;
+        va_start(args, fmt);
+        vfprintf(stderr, fmt, args);
+        va_end(args);
+    }
+};
+
+extern HardwareSerial Serial;
+
+class EspClass
+{
+public:
+    String getSketchMD5() { return "0123456789abcdef0123456789abcdef"; }
+    uint32_t getFreeHeap() { return 40000; }
+    uint32_t getMaxFreeBlockSize() { return 30000; }
+    uint8_t getHeapFragmentation() { return 25; }
+};
+
+extern EspClass ESP;
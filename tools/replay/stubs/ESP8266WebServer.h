@@ -0,0 +1,403 @@
+#pragma once
+
+#include <Arduino.h>
+#include <SD.h>
+
+#include <climits>
+#include <functional>
+#include <map>
+#include <vector>
+
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define HTTP_GET 1
+#define HTTP_POST 2
+#define CONTENT_LENGTH_UNKNOWN ((size_t)-1)
+#define HTTP_MAX_DATA_WAIT 5000  // ms to wait for the request of a new connection
+#define HTTP_MAX_CLOSE_WAIT 2000 // ms to keep an idle connection open
+
+// SPIFFS backed by a host directory. Files are read into memory on open.
+class FSStub
+{
+public:
+    std::string root = "data";
+
+    bool begin() { return true; }
+    bool exists(const char *path)
+    {
+        struct stat st;
+        return stat((root + path).c_str(), &st) == 0 && S_ISREG(st.st_mode);
+    }
+    File open(const char *path, const char *mode)
+    {
+        FILE *file = fopen((root + path).c_str(), "rb");
+        if (!file)
+            return File();
+        auto data = std::make_shared<std::string>();
+        char buf[4096];
+        size_t n;
+        while ((n = fread(buf, 1, sizeof(buf), file)) > 0)
+            data->append(buf, n);
+        fclose(file);
+        return File(data, 0);
+    }
+};
+
+extern FSStub SPIFFS;
+
+// Replaces the port passed to WiFiServer::begin() when set, see serve.cpp
+extern uint16_t stub_server_port;
+
+class WiFiServer
+{
+public:
+    int fd = -1;
+
+    void begin(uint16_t port, uint8_t backlog)
+    {
+        if (stub_server_port)
+            port = stub_server_port;
+        fd = socket(AF_INET, SOCK_STREAM, 0);
+        int flag = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &flag, sizeof(flag));
+        struct sockaddr_in addr = {};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port);
+        addr.sin_addr.s_addr = htonl(INADDR_ANY);
+        if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(fd, backlog) != 0)
+        {
+            perror("listen");
+            exit(1);
+        }
+    }
+    void setNoDelay(bool nodelay) {}
+    bool hasClient()
+    {
+        struct pollfd p = {fd, POLLIN, 0};
+        return fd >= 0 && poll(&p, 1, 0) > 0;
+    }
+};
+
+// The part of the ESP8266WebServer API used by server.cpp, over blocking
+// sockets. Like the original it serves one connection at a time from
+// handleClient(), so a slow response delays the rest of the loop just as
+// it does on the device. Connections are kept alive until idle for
+// HTTP_MAX_CLOSE_WAIT or another client is waiting.
+class ESP8266WebServer
+{
+public:
+    typedef std::function<void(void)> THandlerFunction;
+
+private:
+    struct Route
+    {
+        std::string uri;
+        int method;
+        THandlerFunction handler;
+    };
+
+    uint16_t port;
+    WiFiServer listener;
+    std::vector<Route> routes;
+    THandlerFunction not_found;
+    std::vector<std::string> header_keys;
+
+    int client = -1;
+    unsigned long idle_since = 0;
+    bool served = false; // At least one request on this connection
+    std::string input;
+
+    String request_uri;
+    std::map<std::string, std::string> args;
+    std::vector<String> header_values;
+    std::string response_headers;
+    size_t content_length = 0;
+    bool chunked = false;
+    bool keep_alive = true;
+
+    void close_client()
+    {
+        if (client >= 0)
+            ::close(client);
+        client = -1;
+        input.clear();
+    }
+
+    void write_all(const char *data, size_t len)
+    {
+        while (client >= 0 && len > 0)
+        {
+            ssize_t n = ::send(client, data, len, MSG_NOSIGNAL);
+            if (n <= 0)
+            {
+                close_client();
+                return;
+            }
+            data += n;
+            len -= n;
+        }
+    }
+
+    static std::string decode(const std::string &str)
+    {
+        std::string out;
+        for (size_t i = 0; i < str.size(); i++)
+        {
+            if (str[i] == '%' && i + 2 < str.size())
+            {
+                out += (char)strtol(str.substr(i + 1, 2).c_str(), NULL, 16);
+                i += 2;
+            }
+            else
+            {
+                out += str[i] == '+' ? ' ' : str[i];
+            }
+        }
+        return out;
+    }
+
+    // Reads until a complete request header is buffered, false on timeout or close
+    bool read_request(std::string &head)
+    {
+        size_t end;
+        unsigned long start = millis_real();
+        while ((end = input.find("\r\n\r\n")) == std::string::npos)
+        {
+            struct pollfd p = {client, POLLIN, 0};
+            if (millis_real() - start > HTTP_MAX_DATA_WAIT || poll(&p, 1, 100) < 0)
+                return false;
+            if (!(p.revents & (POLLIN | POLLHUP)))
+                continue;
+            char buf[1024];
+            ssize_t n = recv(client, buf, sizeof(buf), 0);
+            if (n <= 0)
+                return false;
+            input.append(buf, n);
+        }
+        head = input.substr(0, end + 2);
+        input.erase(0, end + 4);
+        return true;
+    }
+
+    void parse_query(const std::string &query)
+    {
+        size_t pos = 0;
+        while (pos < query.size())
+        {
+            size_t amp = query.find('&', pos);
+            std::string pair = query.substr(pos, amp == std::string::npos ? std::string::npos : amp - pos);
+            size_t eq = pair.find('=');
+            args[decode(pair.substr(0, eq))] = eq == std::string::npos ? "" : decode(pair.substr(eq + 1));
+            pos = amp == std::string::npos ? query.size() : amp + 1;
+        }
+    }
+
+    void handle_request(const std::string &head)
+    {
+        size_t sp1 = head.find(' ');
+        size_t sp2 = head.find(' ', sp1 + 1);
+        std::string method = head.substr(0, sp1);
+        std::string target = head.substr(sp1 + 1, sp2 - sp1 - 1);
+        size_t q = target.find('?');
+        request_uri = decode(target.substr(0, q)).c_str();
+        args.clear();
+        if (q != std::string::npos)
+            parse_query(target.substr(q + 1));
+
+        header_values.assign(header_keys.size(), String());
+        keep_alive = head.compare(sp2 + 1, 8, "HTTP/1.1") == 0;
+        size_t body_len = 0;
+        for (size_t pos = head.find("\r\n") + 2; pos < head.size(); pos = head.find("\r\n", pos) + 2)
+        {
+            std::string line = head.substr(pos, head.find("\r\n", pos) - pos);
+            size_t colon = line.find(':');
+            if (colon == std::string::npos)
+                continue;
+            std::string name = line.substr(0, colon);
+            size_t start = line.find_first_not_of(' ', colon + 1);
+            std::string value = start == std::string::npos ? "" : line.substr(start);
+            for (size_t i = 0; i < header_keys.size(); i++)
+            {
+                if (strcasecmp(name.c_str(), header_keys[i].c_str()) == 0)
+                {
+                    header_values[i] = value.c_str(); // Only the first matching slot, as in the core
+                    break;
+                }
+            }
+            if (strcasecmp(name.c_str(), "Connection") == 0)
+                keep_alive = strcasecmp(value.c_str(), "close") != 0;
+            if (strcasecmp(name.c_str(), "Content-Length") == 0)
+                body_len = strtoul(value.c_str(), NULL, 10);
+        }
+        if (input.size() >= body_len) // Bodies are not used, only skipped
+            input.erase(0, body_len);
+
+        response_headers.clear();
+        content_length = 0;
+        chunked = false;
+        int m = method == "POST" ? HTTP_POST : HTTP_GET;
+        for (const Route &route : routes)
+        {
+            if (route.method == m && route.uri == request_uri.c_str())
+            {
+                route.handler();
+                return;
+            }
+        }
+        not_found();
+    }
+
+    static unsigned long millis_real()
+    {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+    }
+
+    static const char *reason(int code)
+    {
+        switch (code)
+        {
+        case 200:
+            return "OK";
+        case 304:
+            return "Not Modified";
+        case 404:
+            return "Not Found";
+        }
+        return "Error";
+    }
+
+public:
+    ESP8266WebServer(uint16_t port) : port(port) {}
+
+    WiFiServer &getServer() { return listener; }
+    void begin() { listener.begin(port, 4); }
+
+    void on(const char *uri, int method, THandlerFunction handler) { routes.push_back({uri, method, handler}); }
+    void onNotFound(THandlerFunction handler) { not_found = handler; }
+    // Like core 3.x, Authorization and If-None-Match always take the first
+    // two slots and the caller's keys follow
+    void collectHeaders(const char *keys[], size_t count)
+    {
+        header_keys = {"Authorization", "If-None-Match"};
+        header_keys.insert(header_keys.end(), keys, keys + count);
+    }
+
+    const String &uri() const { return request_uri; }
+    const String &header(int i) const { return header_values[i]; }
+    String header(const char *name) const
+    {
+        for (size_t i = 0; i < header_keys.size(); i++)
+        {
+            if (strcasecmp(name, header_keys[i].c_str()) == 0)
+                return header_values[i];
+        }
+        return String();
+    }
+    String headerName(int i) const { return header_keys[i].c_str(); }
+    int headers() const { return header_keys.size(); }
+    bool hasArg(const char *name) const { return args.count(name) > 0; }
+    String arg(const char *name) const
+    {
+        auto it = args.find(name);
+        return it == args.end() ? String() : String(it->second);
+    }
+
+    void sendHeader(const String &name, const String &value)
+    {
+        response_headers += std::string(name.c_str()) + ": " + value.c_str() + "\r\n";
+    }
+    void setContentLength(size_t len) { content_length = len; }
+
+    void send(int code, const char *content_type, const char *content, size_t len)
+    {
+        std::string head = "HTTP/1.1 " + std::to_string(code) + " " + reason(code) + "\r\n";
+        if (content_type)
+            head += std::string("Content-Type: ") + content_type + "\r\n";
+        chunked = content_length == CONTENT_LENGTH_UNKNOWN;
+        if (chunked)
+            head += "Transfer-Encoding: chunked\r\n";
+        else
+            head += "Content-Length: " + std::to_string(content_length ? content_length : len) + "\r\n";
+        head += response_headers + "Connection: " + (keep_alive ? "keep-alive" : "close") + "\r\n\r\n";
+        write_all(head.data(), head.size());
+        if (len)
+            sendContent(content, len);
+    }
+    void send(int code, const char *content_type = NULL, const String &content = String())
+    {
+        send(code, content_type, content.c_str(), content.length());
+    }
+    void send_P(int code, const char *content_type, PGM_P content, size_t len) { send(code, content_type, content, len); }
+
+    void sendContent(const char *content, size_t len)
+    {
+        if (!chunked)
+        {
+            write_all(content, len);
+            return;
+        }
+        char size[16];
+        int n = snprintf(size, sizeof(size), "%zx\r\n", len);
+        std::string chunk(size, n);
+        chunk.append(content, len);
+        chunk += "\r\n"; // The empty chunk ends the response
+        write_all(chunk.data(), chunk.size());
+    }
+    void sendContent(const String &content) { sendContent(content.c_str(), content.length()); }
+
+    size_t streamFile(File &file, const String &content_type)
+    {
+        size_t size = file.size();
+        setContentLength(size);
+        send(200, content_type.c_str(), "", 0);
+        char buf[1460];
+        int n;
+        while (client >= 0 && (n = file.read((uint8_t *)buf, sizeof(buf))) > 0)
+            write_all(buf, n);
+        return size;
+    }
+
+    void handleClient()
+    {
+        if (client < 0)
+        {
+            if (!listener.hasClient())
+                return;
+            client = accept(listener.fd, NULL, NULL);
+            int flag = 1;
+            setsockopt(client, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(flag));
+            idle_since = millis_real();
+            served = false;
+        }
+
+        struct pollfd p = {client, POLLIN, 0};
+        if (input.empty() && poll(&p, 1, 0) == 0)
+        {
+            // A new connection gets time to send its request, an idle
+            // keep-alive one is closed as soon as another client waits
+            unsigned long idle = millis_real() - idle_since;
+            if (served ? idle > HTTP_MAX_CLOSE_WAIT || listener.hasClient() : idle > HTTP_MAX_DATA_WAIT)
+                close_client();
+            return;
+        }
+
+        std::string head;
+        if (!read_request(head))
+        {
+            close_client();
+            return;
+        }
+        handle_request(head);
+        served = true;
+        if (!keep_alive)
+            close_client();
+        idle_since = millis_real();
+    }
+};
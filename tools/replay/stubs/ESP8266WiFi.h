@@ -0,0 +1,144 @@
+#pragma once
+
+#include <Arduino.h>
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <linux/sockios.h>
+#include <netdb.h>
+#include <netinet/tcp.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#define WL_CONNECTED 3
+#define TCP_SND_BUF 2920 // lwIP send buffer on the ESP8266
+
+// Just enough of IPAddress to resolve a name and connect to it
+class IPAddress
+{
+public:
+    struct in_addr addr = {};
+};
+
+class ESP8266WiFiClass
+{
+public:
+    int status() { return WL_CONNECTED; }
+    int RSSI() { return -60; }
+
+    // Blocks in getaddrinfo(), the timeout is ignored
+    int hostByName(const char *host, IPAddress &result, uint32_t timeout_ms)
+    {
+        struct addrinfo hints = {}, *info;
+        hints.ai_family = AF_INET;
+        if (getaddrinfo(host, NULL, &hints, &info) != 0)
+            return 0;
+        result.addr = ((struct sockaddr_in *)info->ai_addr)->sin_addr;
+        freeaddrinfo(info);
+        return 1;
+    }
+};
+
+static ESP8266WiFiClass WiFi;
+
+// Non-blocking socket with the send buffer limit of the ESP8266, so
+// availableForWrite() pushes back like it does on the device
+class WiFiClient
+{
+    int fd = -1;
+    unsigned long timeout_ms = 1000;
+
+public:
+    void setTimeout(unsigned long ms) { timeout_ms = ms; }
+    void setNoDelay(bool nodelay)
+    {
+        int flag = nodelay;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(flag));
+    }
+
+    int connect(IPAddress ip, uint16_t port)
+    {
+        stop();
+        struct sockaddr_in addr = {};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port);
+        addr.sin_addr = ip.addr;
+        fd = socket(AF_INET, SOCK_STREAM, 0);
+        struct timeval tv = {(time_t)(timeout_ms / 1000), (suseconds_t)(timeout_ms % 1000) * 1000};
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+        if (::connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0)
+        {
+            stop();
+            return 0;
+        }
+        fcntl(fd, F_SETFL, O_NONBLOCK);
+        return 1;
+    }
+
+    uint8_t connected()
+    {
+        if (fd < 0)
+            return 0;
+        char c;
+        ssize_t n = recv(fd, &c, 1, MSG_PEEK | MSG_DONTWAIT);
+        if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK))
+        {
+            stop();
+            return 0;
+        }
+        return 1;
+    }
+
+    int availableForWrite()
+    {
+        int queued = 0;
+        if (fd < 0 || ioctl(fd, SIOCOUTQ, &queued) != 0)
+            return 0;
+        return queued < TCP_SND_BUF ? TCP_SND_BUF - queued : 0;
+    }
+
+    size_t write(const uint8_t *buf, size_t len)
+    {
+        if (fd < 0)
+            return 0;
+        ssize_t n = send(fd, buf, len, MSG_NOSIGNAL | MSG_DONTWAIT);
+        return n < 0 ? 0 : n;
+    }
+
+    int available()
+    {
+        int n = 0;
+        if (fd < 0 || ioctl(fd, FIONREAD, &n) != 0)
+            return 0;
+        return n;
+    }
+
+    size_t peekBytes(uint8_t *buf, size_t len)
+    {
+        if (fd < 0)
+            return 0;
+        ssize_t n = recv(fd, buf, len, MSG_PEEK | MSG_DONTWAIT);
+        return n < 0 ? 0 : n;
+    }
+
+    int read()
+    {
+        uint8_t c;
+        return read(&c, 1) == 1 ? c : -1;
+    }
+
+    int read(uint8_t *buf, size_t len)
+    {
+        if (fd < 0)
+            return -1;
+        return recv(fd, buf, len, MSG_DONTWAIT);
+    }
+
+    void stop()
+    {
+        if (fd >= 0)
+            close(fd);
+        fd = -1;
+    }
+};
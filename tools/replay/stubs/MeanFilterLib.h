@@ -0,0 +1,33 @@
+#pragma once
+
+#include <stddef.h>
+
+template <typename T>
+class MeanFilter
+{
+    T *items;
+    size_t size;
+    size_t index = 0;
+    size_t count = 0;
+    T sum = 0;
+
+public:
+    MeanFilter(size_t windowSize) : size(windowSize)
+    {
+        items = new T[size]();
+    }
+    ~MeanFilter()
+    {
+        delete[] items;
+    }
+    T AddValue(T value)
+    {
+        sum += value - items[index];
+        items[index] = value;
+        index = (index + 1) % size;
+        if (count < size)
+            count++;
+        return GetFiltered();
+    }
+    T GetFiltered() { return sum / (T)count; }
+};
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <algorithm>
+
+template <typename T>
+class MedianFilter
+{
+    T *items;
+    T *sorted;
+    size_t size;
+    size_t index = 0;
+    T median = 0;
+
+public:
+    MedianFilter(size_t windowSize) : size(windowSize)
+    {
+        items = new T[size]();
+        sorted = new T[size];
+    }
+    ~MedianFilter()
+    {
+        delete[] items;
+        delete[] sorted;
+    }
+    T AddValue(T value)
+    {
+        items[index] = value;
+        index = (index + 1) % size;
+        std::copy(items, items + size, sorted);
+        std::nth_element(sorted, sorted + size / 2, sorted + size);
+        median = sorted[size / 2];
+        return median;
+    }
+    T GetFiltered() { return median; }
+};
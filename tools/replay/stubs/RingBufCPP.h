@@ -0,0 +1,44 @@
+#pragma once
+
+#include <stddef.h>
+
+template <typename Type, size_t MaxElements>
+class RingBufCPP
+{
+    Type buf[MaxElements];
+    size_t head = 0;
+    size_t count = 0;
+
+public:
+    bool add(const Type &obj, bool overwrite = false)
+    {
+        if (count == MaxElements)
+        {
+            if (!overwrite)
+                return false;
+            head = (head + 1) % MaxElements;
+            count--;
+        }
+        buf[(head + count) % MaxElements] = obj;
+        count++;
+        return true;
+    }
+    bool pull(Type *dest)
+    {
+        if (count == 0)
+            return false;
+        *dest = buf[head];
+        head = (head + 1) % MaxElements;
+        count--;
+        return true;
+    }
+    Type *peek(size_t num)
+    {
+        if (num >= count)
+            return NULL;
+        return &buf[(head + num) % MaxElements];
+    }
+    bool isFull() { return count == MaxElements; }
+    bool isEmpty() { return count == 0; }
+    size_t numElements() { return count; }
+};
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <Arduino.h>
+
+#define FILE_READ 0
+#define FILE_WRITE 1
+
+// In-memory file system so the history code can run unchanged. Copies of a
+// File share their position, like the handles of the SD library do.
+class File
+{
+    struct Handle
+    {
+        std::shared_ptr<std::string> data;
+        size_t pos;
+    };
+    std::shared_ptr<Handle> handle;
+
+public:
+    File() {}
+    File(std::shared_ptr<std::string> data, size_t pos) : handle(new Handle{data, pos}) {}
+    operator bool() const { return (bool)handle; }
+    int available() { return handle ? handle->data->size() - handle->pos : 0; }
+    int read()
+    {
+        if (!available())
+            return -1;
+        return (uint8_t)(*handle->data)[handle->pos++];
+    }
+    int read(uint8_t *buf, size_t len)
+    {
+        size_t n = std::min(len, (size_t)available());
+        memcpy(buf, handle->data->data() + handle->pos, n);
+        handle->pos += n;
+        return n;
+    }
+    size_t write(const uint8_t *buf, size_t len)
+    {
+        handle->data->append((const char *)buf, len);
+        handle->pos = handle->data->size();
+        return len;
+    }
+    size_t write(const char *str) { return write((const uint8_t *)str, strlen(str)); }
+    bool seek(size_t offset)
+    {
+        if (!handle || offset > handle->data->size())
+            return false;
+        handle->pos = offset;
+        return true;
+    }
+    size_t position() { return handle ? handle->pos : 0; }
+    size_t size() { return handle ? handle->data->size() : 0; }
+    void close() { handle.reset(); }
+};
+
+class SDClass
+{
+    std::map<std::string, std::shared_ptr<std::string>> files;
+
+public:
+    bool begin(uint8_t cs) { return true; }
+    bool exists(const String &path) { return files.count(path.c_str()) > 0; }
+    bool remove(const String &path) { return files.erase(path.c_str()) > 0; }
+    File open(const String &path, uint8_t mode = FILE_READ)
+    {
+        auto it = files.find(path.c_str());
+        if (it == files.end())
+        {
+            if (mode == FILE_READ)
+                return File();
+            it = files.emplace(path.c_str(), std::make_shared<std::string>()).first;
+        }
+        return File(it->second, mode == FILE_WRITE ? it->second->size() : 0);
+    }
+};
+
+extern SDClass SD;
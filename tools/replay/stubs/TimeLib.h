@@ -0,0 +1,13 @@
+#pragma once
+
+#include <time.h>
+
+// Virtual wall clock of the replay engine
+time_t now();
+void setTime(time_t t);
+int year();
+int month();
+int day();
+int hour();
+int minute();
+int second();
@@ -0,0 +1,7 @@
+#pragma once
+
+// Used when the sketch directory has no settings.h. Log output goes to
+// stderr when replay is run with -v.
+#define LOG_USE_SERIAL
+#define LOG_SERIAL_BAUDRATE 115200
+#define LOG_SYSLOG_SERVER "127.0.0.1"
@@ -0,0 +1,108 @@
+#!/usr/bin/env python3
+"""Write a synthetic sensor trace in the TRACE_RECORD format.
+
+Simulates a tank that slowly loses water, fills during rain and is drawn
+down by short pump runs, with sensor noise and occasional spurious echoes.
+Useful for exercising tools/replay without a recording from the field.
+
+Usage: synth_trace.py [--days 7] [--seed 1] [--truth truth.csv] out.bin
+
+--truth writes the true level (per mille) at each echo burst, as used by
+bench_level.
+"""
+
+import argparse
+import random
+import struct
+
+TRACE_TIME, TRACE_ECHO, TRACE_CURRENT, TRACE_SESSION = 0, 1, 2, 15
+
+TANK_HEIGHT_MM = 920
+TANK_TOP_DISTANCE_MM = 40
+START_EPOCH = 1594512000
+
+
+def varint(value):
+    out = bytearray()
+    while value >= 0x80:
+        out.append((value & 0x7F) | 0x80)
+        value >>= 7
+    out.append(value)
+    return out
+
+
+def zigzag(value):
+    return ((value << 1) ^ (value >> 31)) & 0xFFFFFFFF
+
+
+class Writer:
+    def __init__(self, f):
+        self.f = f
+        self.last_t = 0
+        self.last_value = {}
+        f.write(bytes([TRACE_SESSION]) + b"TLT1")
+
+    def record(self, t, kind, value):
+        diff = value - self.last_value.get(kind, 0)
+        self.f.write(bytes([kind]) + varint(t - self.last_t) + varint(zigzag(diff)))
+        self.last_t = t
+        self.last_value[kind] = value
+
+
+def level_to_echo(level):
+    distance = TANK_TOP_DISTANCE_MM + TANK_HEIGHT_MM * (1000 - level) / 1000
+    return int(distance * 200 / 34)
+
+
+def ma_to_adc(ma):
+    return int(1024 - ma * 409 / 10000)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--days", type=float, default=7)
+    parser.add_argument("--seed", type=int, default=1)
+    parser.add_argument("--truth", help="write ms,level per burst to this CSV file")
+    parser.add_argument("output")
+    args = parser.parse_args()
+    rnd = random.Random(args.seed)
+
+    level = 600.0
+    rain_left = 0
+    pump_left = 0
+    truth = open(args.truth, "w") if args.truth else None
+    with open(args.output, "wb") as f:
+        w = Writer(f)
+        end_ms = int(args.days * 86400 * 1000)
+        for t in range(0, end_ms, 100):
+            if t % 3600000 == 0:
+                w.record(t, TRACE_TIME, START_EPOCH + t // 1000)
+            if t % 1000 == 0:
+                if rain_left == 0 and rnd.random() < 1 / (2 * 86400):
+                    rain_left = rnd.randint(1800, 4 * 3600)
+                if pump_left == 0 and rnd.random() < 1 / (12 * 3600):
+                    pump_left = rnd.randint(120, 600)
+                level -= 0.5 / 3600
+                if rain_left:
+                    rain_left -= 1
+                    level += 40 / 3600
+                if pump_left:
+                    pump_left -= 1
+                    level -= 300 / 3600
+                level = min(max(level, 0), 1000)
+            current = rnd.gauss(4000 if pump_left else 0, 60)
+            w.record(t, TRACE_CURRENT, ma_to_adc(max(current, 0)))
+            if t % 60000 == 0:
+                if truth:
+                    truth.write("%d,%.2f\n" % (t, level))
+                for i in range(5):
+                    echo = level_to_echo(level) + int(rnd.gauss(0, 8))
+                    if rnd.random() < 0.02:
+                        echo = rnd.randint(200, 6000)
+                    w.record(t + i * 6, TRACE_ECHO, echo)
+    if truth:
+        truth.close()
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,71 @@
+// Reader for the sensor trace format written by trace.cpp
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+#include "../../trace.h"
+
+struct TraceRecord
+{
+    unsigned long t; // ms since the start of the trace
+    int type;
+    long value;
+};
+
+static bool trace_get_varint(FILE *file, uint32_t &value)
+{
+    value = 0;
+    for (int shift = 0; shift < 35; shift += 7)
+    {
+        int c = fgetc(file);
+        if (c == EOF)
+            return false;
+        value |= (uint32_t)(c & 0x7F) << shift;
+        if (!(c & 0x80))
+            return true;
+    }
+    return false;
+}
+
+// Sessions are appended back to back: millis() restarted on the device,
+// virtual time keeps running.
+static bool trace_file_load(const char *path, std::vector<TraceRecord> &records)
+{
+    FILE *file = fopen(path, "rb");
+    if (!file)
+    {
+        perror(path);
+        return false;
+    }
+    long last_value[TraceSession] = {};
+    unsigned long t = 0;
+    int type;
+    while ((type = fgetc(file)) != EOF)
+    {
+        if (type == TraceSession)
+        {
+            char magic[4];
+            if (fread(magic, 1, sizeof(magic), file) != sizeof(magic) || memcmp(magic, "TLT1", 4) != 0)
+            {
+                fprintf(stderr, "%s: bad session header\n", path);
+                break;
+            }
+            memset(last_value, 0, sizeof(last_value));
+            continue;
+        }
+        uint32_t dt, zz;
+        if (type > TraceCurrent || !trace_get_varint(file, dt) || !trace_get_varint(file, zz))
+        {
+            fprintf(stderr, "%s: corrupt record, stopping\n", path);
+            break;
+        }
+        t += dt;
+        last_value[type] += (long)(zz >> 1) ^ -(long)(zz & 1);
+        records.push_back({t, type, last_value[type]});
+    }
+    fclose(file);
+    return true;
+}
@@ -0,0 +1,14 @@
+#!/bin/sh
+# Builds loadgen for raw line protocol (port 18094) and MQTT (port 11883)
+set -e
+cd "$(dirname "$0")"
+SKETCH=../..
+STUBS=../replay/stubs
+for variant in line mqtt; do
+    FLAGS='-DTELEMETRY_SERVER="127.0.0.1" -DTELEMETRY_PORT=18094'
+    if [ $variant = mqtt ]; then
+        FLAGS='-DTELEMETRY_SERVER="127.0.0.1" -DTELEMETRY_PORT=11883 -DTELEMETRY_MQTT_TOPIC="tank/telemetry"'
+    fi
+    ${CXX:-g++} -std=c++11 -O2 -Wall -I$STUBS -I$SKETCH $FLAGS \
+        loadgen.cpp $SKETCH/telemetry.cpp $SKETCH/Log.cpp -o loadgen_$variant
+done
@@ -0,0 +1,101 @@
+// Drives telemetry.cpp on the host against a collector, e.g. stub_server.py,
+// using the stubs of tools/replay with real sockets and a real clock.
+//
+// Queues one "tank" sample per simulated minute, with time stamps starting
+// at 1594512000, plus a pump event every 60 samples. The sample rate is in
+// samples per real second. After the last sample it keeps running until the
+// queue and spill are sent, then prints the telemetry stats.
+//
+// Usage: loadgen [-n samples] [-r rate] [-t timeout_s]
+#include <Arduino.h>
+#include <SD.h>
+#include <TimeLib.h>
+
+#include <chrono>
+#include <thread>
+#include <unistd.h>
+
+#include "Log.h"
+#include "telemetry.h"
+
+#define FIRST_TIME_STAMP 1594512000UL
+
+HardwareSerial Serial;
+SDClass SD;
+EspClass ESP;
+
+static const auto start = std::chrono::steady_clock::now();
+
+unsigned long millis()
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+}
+unsigned long micros() { return millis() * 1000; }
+void delay(unsigned long ms) { std::this_thread::sleep_for(std::chrono::milliseconds(ms)); }
+void delayMicroseconds(unsigned int us) {}
+
+time_t now() { return FIRST_TIME_STAMP + millis() / 1000; }
+void setTime(time_t t) {}
+int year() { return 2020; }
+int month() { return 7; }
+int day() { return 12; }
+int hour() { return 0; }
+int minute() { return 0; }
+int second() { return 0; }
+
+int main(int argc, char **argv)
+{
+    long samples = 1000;
+    double rate = 100;
+    unsigned long timeout_s = 120;
+    int opt;
+    while ((opt = getopt(argc, argv, "n:r:t:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'n':
+            samples = atol(optarg);
+            break;
+        case 'r':
+            rate = atof(optarg);
+            break;
+        case 't':
+            timeout_s = atol(optarg);
+            break;
+        default:
+            fprintf(stderr, "Usage: %s [-n samples] [-r rate] [-t timeout_s]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    Log.begin();
+    telemetry_init();
+    long queued = 0;
+    unsigned long worst_us = 0;
+    while (millis() < timeout_s * 1000)
+    {
+        long due = (long)(millis() * rate / 1000);
+        for (; queued < samples && queued < due; queued++)
+        {
+            telemetry_sample(FIRST_TIME_STAMP + queued * 60, queued % 1000, queued % 7, 0);
+            if (queued % 60 == 59)
+            {
+                telemetry_pump_event("Running", 4000);
+            }
+        }
+        auto t0 = std::chrono::steady_clock::now();
+        telemetry_handle();
+        unsigned long us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - t0).count();
+        worst_us = std::max(worst_us, us);
+
+        String stats = telemetry_get_stats_json();
+        if (queued == samples && strstr(stats.c_str(), "\"queued\":0,\"spill\":0"))
+        {
+            break;
+        }
+        delay(1);
+    }
+    printf("%ld samples queued in %lu ms, worst telemetry_handle() %lu us\n%s\n", queued, millis(), worst_us,
+           telemetry_get_stats_json().c_str());
+    return 0;
+}
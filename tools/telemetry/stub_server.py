@@ -0,0 +1,168 @@
+#!/usr/bin/env python3
+"""Loopback collector for testing telemetry.cpp, e.g. with loadgen.
+
+Accepts raw InfluxDB line protocol (like a Telegraf socket_listener) or,
+with --mqtt, an MQTT 3.1.1 client publishing line protocol at QoS 1.
+Checks that the "tank" samples arrive in time stamp order and counts gaps.
+Duplicates are counted too, but are expected after a lost connection. --outage START:LENGTH drops the connection START seconds
+after the first one and refuses connections for LENGTH seconds, to make the
+client spill to SD and drain it afterwards.
+
+Usage: stub_server.py [--mqtt] [--port N] [--outage 2:5] [--expect N]
+"""
+
+import argparse
+import select
+import signal
+import socket
+import sys
+import time
+
+
+class Checker:
+    def __init__(self):
+        self.lines = 0
+        self.samples = 0
+        self.gaps = 0
+        self.duplicates = 0
+        self.last = None
+        self.seen = set()
+
+    def feed(self, data):
+        for line in data.decode().splitlines():
+            if not line:
+                continue
+            self.lines += 1
+            if not line.startswith("tank "):
+                continue
+            ts = int(line.rsplit(" ", 1)[1])
+            if ts in self.seen:
+                self.duplicates += 1
+                continue
+            self.seen.add(ts)
+            self.samples += 1
+            if self.last is not None and ts != self.last + 60:
+                self.gaps += 1
+            self.last = ts
+
+    def report(self):
+        print("lines %d, samples %d, gaps %d, duplicates %d" % (self.lines, self.samples, self.gaps, self.duplicates), flush=True)
+
+
+def read_exact(conn, n, deadline):
+    data = b""
+    while len(data) < n:
+        if time.time() >= deadline:
+            raise ConnectionError
+        try:
+            chunk = conn.recv(n - len(data))
+        except socket.timeout:
+            continue
+        if not chunk:
+            raise ConnectionError
+        data += chunk
+    return data
+
+
+def read_packet(conn, deadline):
+    header = read_exact(conn, 1, deadline)[0]
+    length, shift = 0, 0
+    while True:
+        byte = read_exact(conn, 1, deadline)[0]
+        length |= (byte & 0x7F) << shift
+        shift += 7
+        if not byte & 0x80:
+            break
+    return header, read_exact(conn, length, deadline)
+
+
+def serve_mqtt(conn, checker, deadline, done):
+    while not done():
+        header, body = read_packet(conn, deadline)
+        kind = header >> 4
+        if kind == 1:  # CONNECT
+            conn.sendall(bytes([0x20, 2, 0, 0]))
+        elif kind == 3:  # PUBLISH
+            topic_len = body[0] << 8 | body[1]
+            payload = body[2 + topic_len:]
+            if header & 0x06:  # QoS 1, acknowledge the packet id
+                conn.sendall(bytes([0x40, 2]) + payload[:2])
+                payload = payload[2:]
+            checker.feed(payload)
+        elif kind == 12:  # PINGREQ
+            conn.sendall(bytes([0xD0, 0]))
+        elif kind == 14:  # DISCONNECT
+            return
+
+
+def serve_line(conn, checker, deadline, done):
+    pending = b""
+    while not done():
+        data = read_exact(conn, 1, deadline)
+        data += conn.recv(4096, socket.MSG_DONTWAIT) if select.select([conn], [], [], 0)[0] else b""
+        if not data:
+            return
+        pending += data
+        complete, _, pending = pending.rpartition(b"\n")
+        if complete:
+            checker.feed(complete + b"\n")
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("--mqtt", action="store_true")
+    parser.add_argument("--port", type=int)
+    parser.add_argument("--outage", help="START:LENGTH in seconds")
+    parser.add_argument("--expect", type=int, help="exit after this many samples")
+    parser.add_argument("--timeout", type=float, default=300)
+    args = parser.parse_args()
+    port = args.port or (11883 if args.mqtt else 18094)
+    outage = [float(v) for v in args.outage.split(":")] if args.outage else None
+
+    signal.signal(signal.SIGTERM, signal.default_int_handler)
+    checker = Checker()
+    first_connect = None
+    end = time.time() + args.timeout
+    listener = None
+    try:
+        while time.time() < end and not (args.expect and checker.samples >= args.expect):
+            if listener is None:
+                listener = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+                listener.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+                listener.bind(("127.0.0.1", port))
+                listener.listen(1)
+                listener.settimeout(0.5)
+            try:
+                conn, _ = listener.accept()
+            except socket.timeout:
+                continue
+            now = time.time()
+            if first_connect is None:
+                first_connect = now
+                print("client connected", flush=True)
+            else:
+                print("client reconnected after %.1f s" % (now - first_connect), flush=True)
+            deadline = end
+            if outage and now < first_connect + outage[0]:
+                deadline = first_connect + outage[0]
+            conn.settimeout(0.5)
+            serve = serve_mqtt if args.mqtt else serve_line
+            try:
+                serve(conn, checker, deadline, lambda: args.expect and checker.samples >= args.expect)
+            except (ConnectionError, OSError):
+                pass
+            conn.close()
+            if outage and time.time() >= first_connect + outage[0] and time.time() < first_connect + sum(outage):
+                print("outage for %.1f s" % outage[1], flush=True)
+                listener.close()
+                listener = None
+                time.sleep(first_connect + sum(outage) - time.time())
+                outage = None
+    except KeyboardInterrupt:
+        pass
+    checker.report()
+    sys.exit(0 if checker.gaps == 0 else 1)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,125 @@
+// Records raw sensor readings to SD so field issues can be replayed on a
+// host with tools/replay.
+//
+// File format, a sequence of records:
+//   1 byte   type (TraceType)
+//   varint   milliseconds since the previous record
+//   varint   zigzag(value - previous value of the same type)
+// A TraceSession record (type byte followed by "TLT1") is written each time
+// recording starts and resets the time and value references to zero.
+#include "trace.h"
+
+#ifdef TRACE_RECORD
+
+#include <Arduino.h>
+#include <SD.h>
+#include <TimeLib.h>
+
+#include "Log.h"
+
+#define TRACE_FILE "/trace.bin"
+#define TRACE_BUFFER_SIZE 256
+#define TRACE_MAX_RECORD_SIZE 11 // 1 type byte + 2 varints of max 5 bytes
+#define TRACE_FLUSH_INTERVAL_MS 10000
+#define TRACE_TIME_INTERVAL_S 3600
+#ifndef TRACE_MAX_FILE_SIZE
+#define TRACE_MAX_FILE_SIZE (64UL * 1024 * 1024)
+#endif
+
+static uint8_t buffer[TRACE_BUFFER_SIZE];
+static size_t buffer_len;
+static bool enabled;
+static unsigned long last_record_ms;
+static unsigned long last_flush_ms;
+static time_t last_time_record;
+static long last_value[TraceSession];
+
+static size_t put_varint(uint8_t *dst, uint32_t value)
+{
+    size_t len = 0;
+    while (value >= 0x80)
+    {
+        dst[len++] = (value & 0x7F) | 0x80;
+        value >>= 7;
+    }
+    dst[len++] = value;
+    return len;
+}
+
+static void flush()
+{
+    last_flush_ms = millis();
+    if (buffer_len == 0)
+    {
+        return;
+    }
+    File file = SD.open(TRACE_FILE, FILE_WRITE);
+    if (!file)
+    {
+        Log.error("Failed to open: %s", TRACE_FILE);
+        enabled = false;
+        return;
+    }
+    file.write(buffer, buffer_len);
+    if (file.size() > TRACE_MAX_FILE_SIZE)
+    {
+        Log.warn("Trace file full, recording stopped");
+        enabled = false;
+    }
+    file.close();
+    buffer_len = 0;
+}
+
+void trace_init()
+{
+    static const uint8_t session[] = {TraceSession, 'T', 'L', 'T', '1'};
+    memcpy(buffer, session, sizeof(session));
+    buffer_len = sizeof(session);
+    memset(last_value, 0, sizeof(last_value));
+    last_record_ms = 0;
+    last_time_record = 0;
+    enabled = true;
+    flush();
+    if (enabled)
+    {
+        Log.info("Recording sensor trace to %s", TRACE_FILE);
+    }
+}
+
+void trace_record(TraceType type, long value)
+{
+    if (!enabled)
+    {
+        return;
+    }
+    if (buffer_len + TRACE_MAX_RECORD_SIZE > TRACE_BUFFER_SIZE)
+    {
+        flush();
+    }
+    unsigned long now_ms = millis();
+    long diff = value - last_value[type];
+    buffer[buffer_len++] = type;
+    buffer_len += put_varint(&buffer[buffer_len], now_ms - last_record_ms);
+    buffer_len += put_varint(&buffer[buffer_len], ((uint32_t)diff << 1) ^ (uint32_t)(diff >> 31));
+    last_record_ms = now_ms;
+    last_value[type] = value;
+}
+
+void trace_handle()
+{
+    if (!enabled)
+    {
+        return;
+    }
+    if (year() >= 2000 && now() - last_time_record >= TRACE_TIME_INTERVAL_S)
+    {
+        last_time_record = now();
+        trace_record(TraceTime, now());
+    }
+    if (millis() - last_flush_ms > TRACE_FLUSH_INTERVAL_MS)
+    {
+        flush();
+    }
+}
+
+#endif
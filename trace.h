@@ -0,0 +1,23 @@
+#pragma once
+
+#include <stdint.h>
+#include "feature_config.h"
+
+// Raw sensor trace, see trace.cpp for the file format
+enum TraceType
+{
+    TraceTime = 0,    // Epoch from NTP
+    TraceEcho = 1,    // Ultrasonic echo duration (us) from pulseIn()
+    TraceCurrent = 2, // Pump current ADC reading
+    TraceSession = 15 // Start of a recording session
+};
+
+#ifdef TRACE_RECORD
+void trace_init();
+void trace_record(TraceType type, long value);
+void trace_handle();
+#else
+inline void trace_init() {}
+inline void trace_record(TraceType type, long value) {}
+inline void trace_handle() {}
+#endif
@@ -0,0 +1,259 @@
+// Connects to WIFI_SSID and keeps the connection up.
+//
+// A full connect scans all channels for the access point and then waits
+// for a DHCP lease, which takes seconds. After every connect the BSSID and
+// channel of the access point and the IP lease are kept in RTC memory,
+// which survives resets and OTA updates but not a power cycle. The next
+// connect, after a reboot or a dropped connection, goes directly to that
+// access point on that channel and reuses the lease, so the station can
+// send as soon as it is associated. If the direct connect fails or times
+// out, the cache is dropped and a full connect is made.
+//
+// A reused lease is not renewed, so WIFI_DHCP_DELAY after connecting on one
+// the station reconnects to the same access point with DHCP, which normally
+// offers the same address again. This costs one short outage after each
+// connect on a reused lease, instead of seconds for a full connect.
+// With WIFI_STATIC_IP the address is always static and DHCP is not used.
+#include "wifi_connect.h"
+
+#if FEATURE_WIFI
+
+#include <ESP8266WiFi.h>
+#include <coredecls.h> // crc32()
+
+#include "Log.h"
+
+#define WIFI_RTC_OFFSET 32     // In 4 byte blocks, the first 128 bytes of RTC user memory are used by OTA
+#define WIFI_FAST_TIMEOUT 5000 // ms
+#define WIFI_FULL_TIMEOUT 30000
+#define WIFI_DHCP_DELAY 60000 // ms after a connect on a reused lease
+
+struct wifi_cache_t
+{
+    uint32_t crc; // Of the rest of the record and WIFI_SSID
+    uint8_t bssid[6];
+    uint8_t channel;
+    uint8_t has_lease;
+    uint32_t ip;
+    uint32_t gateway;
+    uint32_t netmask;
+    uint32_t dns;
+};
+
+static wifi_cache_t cache;
+static bool cache_valid = false;
+
+static bool connected = false;
+static bool fast = false;        // The current attempt goes directly to the cached access point
+static bool lease_reused = false; // Connected on the cached lease, DHCP not restarted yet
+static unsigned long attempt_start = 0;
+static unsigned long connect_time = 0;
+static unsigned long assoc_ms = 0;   // Last connect, from the attempt start to association
+static unsigned long connect_ms = 0; // and to the IP address
+static unsigned long connects = 0;
+static unsigned long fast_connects = 0;
+
+// Set by the event handlers, which run in the SDK context
+static volatile unsigned long assoc_time = 0;
+static volatile bool got_ip = false;
+static volatile bool disconnected = false;
+static volatile bool leaving = false; // begin() restarts the station, ignore the disconnect that causes
+static volatile int disconnect_reason = 0;
+
+static WiFiEventHandler connected_handler;
+static WiFiEventHandler got_ip_handler;
+static WiFiEventHandler disconnected_handler;
+
+static uint32_t cache_crc()
+{
+    uint32_t crc = crc32((const uint8_t *)&cache + sizeof(cache.crc), sizeof(cache) - sizeof(cache.crc));
+    return crc32(WIFI_SSID, strlen(WIFI_SSID), crc);
+}
+
+static void load_cache()
+{
+    cache_valid = ESP.rtcUserMemoryRead(WIFI_RTC_OFFSET, (uint32_t *)&cache, sizeof(cache)) &&
+                  cache.crc == cache_crc();
+}
+
+static void store_cache()
+{
+    memcpy(cache.bssid, WiFi.BSSID(), sizeof(cache.bssid));
+    cache.channel = WiFi.channel();
+#ifdef WIFI_STATIC_IP
+    cache.has_lease = 0;
+#else
+    cache.has_lease = 1;
+    cache.ip = WiFi.localIP();
+    cache.gateway = WiFi.gatewayIP();
+    cache.netmask = WiFi.subnetMask();
+    cache.dns = WiFi.dnsIP();
+#endif
+    cache.crc = cache_crc();
+    cache_valid = ESP.rtcUserMemoryWrite(WIFI_RTC_OFFSET, (uint32_t *)&cache, sizeof(cache));
+}
+
+static void drop_cache()
+{
+    cache_valid = false;
+    cache.crc = 0;
+    ESP.rtcUserMemoryWrite(WIFI_RTC_OFFSET, (uint32_t *)&cache, sizeof(cache));
+}
+
+static void begin(bool direct, bool reuse_lease)
+{
+    fast = direct;
+    lease_reused = false;
+    assoc_time = 0;
+    got_ip = false;
+    disconnected = false;
+    leaving = true;
+    attempt_start = millis();
+
+#ifdef WIFI_STATIC_IP
+    IPAddress ip, gateway, netmask, dns;
+    ip.fromString(WIFI_STATIC_IP);
+    gateway.fromString(WIFI_GATEWAY);
+    netmask.fromString(WIFI_NETMASK);
+    dns.fromString(WIFI_DNS);
+    WiFi.config(ip, gateway, netmask, dns);
+#else
+    if (fast && reuse_lease && cache.has_lease)
+    {
+        WiFi.config(IPAddress(cache.ip), IPAddress(cache.gateway), IPAddress(cache.netmask), IPAddress(cache.dns));
+        lease_reused = true;
+    }
+    else
+    {
+        WiFi.config(IPAddress(), IPAddress(), IPAddress()); // DHCP
+    }
+#endif
+
+    if (fast)
+        WiFi.begin(WIFI_SSID, WIFI_PASSKEY, cache.channel, cache.bssid);
+    else
+        WiFi.begin(WIFI_SSID, WIFI_PASSKEY);
+}
+
+static void on_connected()
+{
+    unsigned long now = millis();
+    connected = true;
+    connect_time = now;
+    connect_ms = now - attempt_start;
+    assoc_ms = (assoc_time ? assoc_time : now) - attempt_start;
+    connects++;
+    if (fast)
+        fast_connects++;
+    store_cache();
+
+#ifdef WIFI_STATIC_IP
+    const char *address = "static IP";
+#else
+    const char *address = lease_reused ? "reused lease" : "DHCP";
+#endif
+    Log.info("WiFi connected in %lu ms (%s, associated after %lu ms, %s), channel %d, RSSI: %d dBm", connect_ms,
+             fast ? "direct" : "full scan", assoc_ms, address, WiFi.channel(), WiFi.RSSI());
+}
+
+void wifi_init()
+{
+    load_cache();
+
+    WiFi.persistent(false); // The station config changes with the cached access point, keep it out of flash
+    WiFi.disconnect();
+    WiFi.mode(WIFI_STA);
+    WiFi.setAutoReconnect(false); // Reconnecting is done here, see wifi_handle()
+
+    connected_handler = WiFi.onStationModeConnected([](const WiFiEventStationModeConnected &event) {
+        assoc_time = millis();
+        leaving = false; // Any disconnect from the restart came before this
+    });
+    got_ip_handler = WiFi.onStationModeGotIP([](const WiFiEventStationModeGotIP &event) {
+        got_ip = true;
+    });
+    disconnected_handler = WiFi.onStationModeDisconnected([](const WiFiEventStationModeDisconnected &event) {
+        if (event.reason == WIFI_DISCONNECT_REASON_ASSOC_LEAVE && leaving)
+        {
+            leaving = false; // Our own disconnect when begin() restarts the station
+            return;
+        }
+        disconnect_reason = event.reason;
+        disconnected = true;
+    });
+
+    Log.info("Connecting WiFi to \"%s\"%s", WIFI_SSID, cache_valid ? " on the cached access point" : "");
+    begin(cache_valid, true);
+}
+
+void wifi_handle()
+{
+    if (connected)
+    {
+        if (disconnected)
+        {
+            connected = false;
+            Log.warn("WiFi disconnected, reason %d", disconnect_reason);
+            begin(cache_valid, true);
+        }
+        else if (got_ip)
+        {
+            got_ip = false; // A new DHCP lease
+            store_cache();
+        }
+#ifndef WIFI_STATIC_IP
+        else if (lease_reused && millis() - connect_time > WIFI_DHCP_DELAY)
+        {
+            // A clean reconnect with DHCP, rather than switching the
+            // running station over
+            connected = false;
+            Log.info("WiFi reconnecting to renew the reused lease");
+            begin(true, false);
+        }
+#endif
+        return;
+    }
+
+    if (got_ip)
+    {
+        got_ip = false;
+        on_connected();
+    }
+    else if (fast && (disconnected || millis() - attempt_start > WIFI_FAST_TIMEOUT))
+    {
+        Log.warn("WiFi direct connect failed after %lu ms, reason %d, scanning", millis() - attempt_start,
+                 disconnect_reason);
+        drop_cache();
+        begin(false, false);
+    }
+    else if (!fast && millis() - attempt_start > WIFI_FULL_TIMEOUT)
+    {
+        Log.warn("WiFi connect timed out, reason %d, retrying", disconnect_reason);
+        begin(false, false);
+    }
+}
+
+String wifi_get_stats_json()
+{
+    return "{\"connected\":" + String(connected ? 1 : 0) + ",\"rssi\":" + String(WiFi.RSSI()) +
+           ",\"channel\":" + String(WiFi.channel()) + ",\"assoc_ms\":" + String(assoc_ms) +
+           ",\"connect_ms\":" + String(connect_ms) + ",\"connects\":" + String(connects) +
+           ",\"fast_connects\":" + String(fast_connects) + "}";
+}
+
+#else
+
+#include <ESP8266WiFi.h>
+
+void wifi_init()
+{
+    // The SDK would still connect on its own with the station config saved
+    // in flash by an earlier firmware. Auto connect is cleared for the next
+    // boots and the radio switched off for this one.
+    WiFi.persistent(false);
+    WiFi.setAutoConnect(false);
+    WiFi.mode(WIFI_OFF);
+    WiFi.forceSleepBegin();
+}
+
+#endif
@@ -0,0 +1,15 @@
+#pragma once
+
+#include <Arduino.h>
+#include "feature_config.h"
+
+// Station mode with a fast reconnect to the last access point, see wifi_connect.cpp
+#if FEATURE_WIFI
+void wifi_init();
+void wifi_handle();
+String wifi_get_stats_json();
+#else
+void wifi_init(); // Turns the radio off
+inline void wifi_handle() {}
+inline String wifi_get_stats_json() { return "null"; }
+#endif